@@ -0,0 +1,291 @@
+// loading things without stopping the world. the workers read and decode,
+// the main thread only does what has to happen there (gpu and al uploads),
+// and only for a little while every frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_atomic.h>
+
+#define BASKET_INTERNAL
+#include "basket.h"
+
+#define ASSET_AMOUNT 1024
+#define FINISH_BUDGET 0.002 // seconds per frame, at least one always gets done
+
+typedef struct {
+    AssetRequest request;
+    char *path;
+
+    int state;       // main thread only
+    bool abandoned;  // ast_free'd while the workers still had it
+
+    // written by the worker, read once decoded is set
+    SDL_atomic_t decoded;
+    bool failed;
+
+    PakView view;  // the file, straight from the package when possible
+    bool keep;     // something still points into view
+
+    Image image;
+    DecodedSound samples;
+
+    Texture texture;
+    Sound sound;
+    Model model;
+    Font font;
+} Slot;
+
+static Slot slots[ASSET_AMOUNT];
+static bool set_up;
+
+int ast_init() {
+    set_up = true;
+    return 0;
+}
+
+static Slot *slot_of(Asset asset) {
+    if (!asset || asset > ASSET_AMOUNT)
+        return NULL;
+
+    Slot *slot = &slots[asset-1];
+
+    if (slot->state == AST_STATE_NONE || slot->abandoned)
+        return NULL;
+
+    return slot;
+}
+
+static void load_job(void *userdata, u32 index) {
+    (void)index;
+    Slot *slot = userdata;
+
+    slot->failed = pak_map(slot->path, &slot->view);
+
+    const char *data = slot->view.data;
+    u32 size = slot->view.size;
+
+    if (!slot->failed) {
+        switch (slot->request.kind) {
+            case AST_KIND_TEXTURE: {
+                // compressed ones go up as they are if the gpu takes them,
+                // otherwise they get decoded here like everything else
+                CompressedImage compressed;
+                if (!ren_tex_compressed() || img_compressed(&compressed, data, size))
+                    slot->failed = img_init(&slot->image, data, size);
+            } break;
+
+            case AST_KIND_MODEL:
+                // bbm models get used right out of the package
+                slot->keep = !mod_map(&slot->model, data, size);
+
+                if (!slot->keep)
+                    slot->failed = mod_init(&slot->model, data, size);
+                break;
+
+            case AST_KIND_SOUND:
+                slot->failed = aud_decode_ogg(
+                    &slot->samples, (const u8 *)data, size,
+                    slot->request.spatialize
+                );
+                break;
+
+            case AST_KIND_FONT:
+                slot->failed = fnt_init(&slot->font, data, size, slot->request.size);
+                break;
+        }
+    }
+
+    SDL_AtomicSet(&slot->decoded, 1);
+}
+
+Asset ast_load(const char *path, AssetRequest request) {
+    if (!set_up || !path)
+        return 0;
+
+    for (u32 i = 0; i < ASSET_AMOUNT; i++) {
+        Slot *slot = &slots[i];
+
+        if (slot->state != AST_STATE_NONE)
+            continue;
+
+        *slot = (Slot) {
+            .request = request,
+            .path = SDL_strdup(path),
+            .state = AST_STATE_LOADING,
+        };
+
+        if (!slot->path) {
+            slot->state = AST_STATE_NONE;
+            return 0;
+        }
+
+        job_push(load_job, slot);
+
+        return i+1;
+    }
+
+    return 0;
+}
+
+// whatever is still around, the slot goes back to being free
+static void release(Slot *slot) {
+    pak_unmap(&slot->view);
+
+    img_free(&slot->image);
+
+    if (slot->samples.samples)
+        free(slot->samples.samples);
+
+    if (slot->texture)
+        ren_tex_free(slot->texture);
+
+    if (slot->sound)
+        aud_unload(slot->sound);
+
+    // these only mean anything if decoding went well
+    if (!slot->failed) {
+        if (slot->request.kind == AST_KIND_MODEL)
+            mod_free(&slot->model);
+
+        if (slot->request.kind == AST_KIND_FONT)
+            fnt_free(&slot->font);
+    }
+
+    SDL_free(slot->path);
+
+    *slot = (Slot) { 0 };
+}
+
+// the main thread part, true if it went well
+static bool finish(Slot *slot) {
+    switch (slot->request.kind) {
+        case AST_KIND_TEXTURE:
+            if (slot->image.pixels) {
+                slot->texture = ren_tex_load_custom(slot->image);
+                img_free(&slot->image);
+            } else {
+                slot->texture = ren_tex_load(slot->view.data, slot->view.size);
+            }
+
+            return slot->texture != 0;
+
+        case AST_KIND_SOUND:
+            return !aud_upload(&slot->sound, &slot->samples);
+
+        default:
+            return true;
+    }
+}
+
+void ast_frame() {
+    if (!set_up) return;
+
+    const u64 frequency = SDL_GetPerformanceFrequency();
+    const u64 start = SDL_GetPerformanceCounter();
+
+    for (u32 i = 0; i < ASSET_AMOUNT; i++) {
+        Slot *slot = &slots[i];
+
+        if (slot->state != AST_STATE_LOADING || !SDL_AtomicGet(&slot->decoded))
+            continue;
+
+        if (slot->abandoned) {
+            release(slot);
+            continue;
+        }
+
+        if ((f64)(SDL_GetPerformanceCounter() - start) / frequency > FINISH_BUDGET)
+            break;
+
+        if (slot->failed || !finish(slot)) {
+            printf("ast_load error: couldn't load %s\n", slot->path);
+
+            slot->failed = true;
+            slot->state = AST_STATE_FAILED;
+        } else {
+            slot->state = AST_STATE_READY;
+        }
+
+        // only plain files and mapped models keep their bytes around
+        if (slot->request.kind != AST_KIND_FILE && !slot->keep)
+            pak_unmap(&slot->view);
+    }
+}
+
+int ast_state(Asset asset) {
+    Slot *slot = slot_of(asset);
+    return slot ? slot->state : AST_STATE_NONE;
+}
+
+void ast_free(Asset asset) {
+    Slot *slot = slot_of(asset);
+    if (!slot) return;
+
+    // the worker still has it, ast_frame cleans up once it's done
+    if (!SDL_AtomicGet(&slot->decoded)) {
+        slot->abandoned = true;
+        return;
+    }
+
+    release(slot);
+}
+
+static Slot *ready_slot(Asset asset, u8 kind) {
+    Slot *slot = slot_of(asset);
+
+    if (!slot || slot->state != AST_STATE_READY || slot->request.kind != kind)
+        return NULL;
+
+    return slot;
+}
+
+const char *ast_file(Asset asset, size_t *size) {
+    Slot *slot = ready_slot(asset, AST_KIND_FILE);
+
+    if (size)
+        *size = slot ? slot->view.size : 0;
+
+    return slot ? slot->view.data : NULL;
+}
+
+Texture ast_texture(Asset asset) {
+    Slot *slot = ready_slot(asset, AST_KIND_TEXTURE);
+    return slot ? slot->texture : 0;
+}
+
+Model *ast_model(Asset asset) {
+    Slot *slot = ready_slot(asset, AST_KIND_MODEL);
+    return slot ? &slot->model : NULL;
+}
+
+Sound ast_sound(Asset asset) {
+    Slot *slot = ready_slot(asset, AST_KIND_SOUND);
+    return slot ? slot->sound : 0;
+}
+
+Font *ast_font(Asset asset) {
+    Slot *slot = ready_slot(asset, AST_KIND_FONT);
+    return slot ? &slot->font : NULL;
+}
+
+void ast_byebye() {
+    if (!set_up) return;
+
+    // the workers might still be busy with some
+    for (u32 i = 0; i < ASSET_AMOUNT; i++) {
+        Slot *slot = &slots[i];
+
+        if (slot->state == AST_STATE_NONE)
+            continue;
+
+        while (!SDL_AtomicGet(&slot->decoded))
+            SDL_Delay(1);
+
+        release(slot);
+    }
+
+    set_up = false;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "lib/AL/al.h"
 #include "lib/AL/alc.h"
@@ -58,11 +59,18 @@ int aud_init() {
     return 0;
 }
 
-int aud_load_ogg(Sound *sound, const u8 *mem, u32 len, bool spatialize) {
+// the decoding half of aud_load_ogg, doesn't touch openal so it's fine on
+// any thread.
+int aud_decode_ogg(DecodedSound *out, const u8 *mem, u32 len, bool spatialize) {
     int channels, sample_rate;
     short *decoded_data;
     int samples = stb_vorbis_decode_memory(mem, len, &channels, &sample_rate, &decoded_data);
 
+    *out = (DecodedSound) { 0 };
+
+    if (samples <= 0 || !decoded_data)
+        return -1;
+
     if (spatialize) {
         // Downmix to mono
         int o = 0;
@@ -92,18 +100,48 @@ int aud_load_ogg(Sound *sound, const u8 *mem, u32 len, bool spatialize) {
         }
     }
 
+    *out = (DecodedSound) {
+        .samples = decoded_data,
+        .amount = samples,
+        .channels = channels,
+        .sample_rate = sample_rate,
+    };
+
+    return 0;
+}
+
+// the openal half, frees the samples either way
+int aud_upload(Sound *sound, DecodedSound *decoded) {
+    if (!decoded->samples)
+        return -1;
+
     alGenBuffers(1, sound);
 
     alBufferData(
-        *sound, (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
-        decoded_data, samples * channels * sizeof(short), sample_rate
+        *sound, (decoded->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
+        decoded->samples, decoded->amount * decoded->channels * sizeof(short),
+        decoded->sample_rate
     );
 
-    free(decoded_data);
+    free(decoded->samples);
+    decoded->samples = NULL;
 
     return 0;
 }
 
+int aud_load_ogg(Sound *sound, const u8 *mem, u32 len, bool spatialize) {
+    DecodedSound decoded;
+
+    if (aud_decode_ogg(&decoded, mem, len, spatialize))
+        return -1;
+
+    return aud_upload(sound, &decoded);
+}
+
+void aud_unload(Sound sound) {
+    alDeleteBuffers(1, &sound);
+}
+
 int aud_init_source(Source *source, Sound audio) {
     alGenSources(1, source);
     alSourcei(*source, AL_BUFFER, audio);
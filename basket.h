@@ -28,7 +28,6 @@ typedef size_t usize;
     - Default to 0, False, NULL
 
     TODO:
-    - Add several passes for rendering with different textures, setups, etc.
     - Finish Audio API, make it comfier to use
     - Documentation
 */
@@ -98,9 +97,58 @@ void err_fatal(const char *title, const char *format, ...);
 
 
 // PACKAGE.C ////////////////////////////////////////////////////
+    typedef struct {
+        size_t size;       // once it's read
+        size_t compressed; // in the package, the same as size if it isn't
+        bool directory;
+    } PakStat;
+
     int pak_mount(const char *name);
+
+    // Mounts another package on top of the ones already mounted, its files
+    // win over the same paths in those. pak_mount drops all of them.
+    int pak_overlay(const char *name);
+
     char *pak_read(const char* name, size_t *size);
 
+    // Without reading anything, non-zero if it isn't there. out can be NULL.
+    int pak_stat(const char *name, PakStat *out);
+
+    typedef struct {
+        const char *name;
+
+        // NULL to get a new buffer (free it), or somewhere to put it that
+        // fits it plus a zero after
+        char *data;
+        size_t capacity;
+
+        size_t size;
+        bool failed;
+    } PakFile;
+
+    // Reads (and inflates) a bunch of files at once on the job workers,
+    // returns how many failed. Reading is fine from several threads at
+    // once, mounting while something reads isn't.
+    u32 pak_read_batch(PakFile *files, u32 amount);
+
+    typedef struct {
+        const char *data;
+        size_t size;
+
+        void *owner; // what pak_unmap lets go of
+        u8 kind;
+    } PakView;
+
+    // Like pak_read, but points straight into the package when it can
+    // (uncompressed zip entries, files in a folder) instead of copying.
+    // Read only. Views into a zip last until the next pak_mount.
+    int pak_map(const char *name, PakView *out);
+    void pak_unmap(PakView *view);
+
+    // Adds a file to a package on disk, a folder or a zip (made if it's
+    // not there). Meant for tools, not for the running game.
+    int pak_store(const char *package, const char *name, const char *data, size_t size);
+
 
 // SAVEFILE.C ///////////////////////////////////////////////////
     int sav_identity(const char *identity);
@@ -108,6 +156,24 @@ void err_fatal(const char *title, const char *format, ...);
     char *sav_retrieve(u32 *length);
 
 
+// JOB.C ////////////////////////////////////////////////////////
+    typedef void (*JobFunction)(void *userdata, u32 index);
+
+    // Calls function once per index across the worker threads, returns
+    // once all of them are done. Safe to call from inside a job.
+    void job_parallel(JobFunction function, void *userdata, u32 amount);
+    u32 job_workers(void);
+
+    // Runs function(userdata, 0) on a worker some time later and returns
+    // right away. Without workers it runs right here instead.
+    void job_push(JobFunction function, void *userdata);
+
+    #ifdef BASKET_INTERNAL
+        int job_init();
+        void job_byebye();
+    #endif
+
+
 // MODEL.C //////////////////////////////////////////////////////
     typedef struct {
         u8 bone[4];
@@ -119,13 +185,27 @@ void err_fatal(const char *title, const char *format, ...);
         VertexAnim *animation; // Can be NULL
         u32 length;
         Box box;
+
+        // Can be NULL, then every three vertices are a triangle
+        u32 *indices;
+        u32 index_amount;
+        u32 lod_index_amount; // more after index_amount, see msh_lods
     } MeshSlice;
 
+    #define LOD_AMOUNT 4
+
+    // Simpler versions of some triangles, the whole ones first. Errors are
+    // how far (in model units) each one is off at most.
+    typedef struct {
+        Range ranges[LOD_AMOUNT];
+        f32 errors[LOD_AMOUNT];
+        u32 amount;
+    } Lods;
+
     typedef struct {
         char name[64];
         u32 parent;
         Transform transform;
-        f32 transform_mat4[16];
     } Bone;
 
     typedef struct {
@@ -145,11 +225,33 @@ void err_fatal(const char *title, const char *format, ...);
         u32 animation_amount;
 
         AnimationFrame *frames, bind_pose, pose;
+        u32 frame_amount;
+
+        u32 *order;          // bones, every parent before its children
+        f32 *inverse_bind;   // bone_amount matrices, model space
+        f32 *transform_mat4; // bone_amount matrices, model space, see mod_pose
+        f32 *palette;        // bone_amount skinning matrices, see mod_pose
+
+        bool borrowed; // made by mod_animation_new, only the pose is its own
+        bool mapped;   // points into a bbm file, see mod_map
     } AnimationState;
 
+    typedef struct {
+        AnimationState *state;
+        u32 animation;
+        f32 time;
+
+        // cross-fades into this one, 0 is just animation, 1 just into
+        u32 into;
+        f32 into_time;
+        f32 fade;
+    } Pose;
+
     typedef struct {
         char *name;
         Range range;
+        Box box;
+        Lods lods;
     } SubMesh;
 
     typedef struct {
@@ -160,11 +262,75 @@ void err_fatal(const char *title, const char *format, ...);
         u32 submesh_amount;
 
         char *extra;
+
+        bool mapped; // points into a bbm file, see mod_map
+        char *copy;  // the copy of it mod_init made
     } Model;
 
-    int mod_init(Model *model, const char *data);
+    // .iqm (version 2) or .bbm files, non-zero if it's neither or broken
+    int mod_init(Model *model, const char *data, size_t size);
     void mod_free(Model *model);
 
+    // Uses a .bbm file as it is, without parsing or copying it (like a
+    // pak_map view), so it has to stay around, and unchanged, until
+    // mod_free. Non-zero if it isn't a good bbm or data isn't 4 byte
+    // aligned. mod_init takes bbm files too, it just copies them first.
+    int mod_map(Model *model, const char *data, size_t size);
+
+    // Writes the model as a .bbm file into a package with pak_store, for
+    // converting .iqm files offline.
+    int mod_store(const Model *model, const char *package, const char *name);
+
+    // a slice of just that submesh, with its own box (empty if out of
+    // range). It doesn't have the lods, to draw those use the whole mesh
+    // with SubMesh.lods.
+    MeshSlice mod_submesh(Model *model, u32 index);
+
+    // msh_optimize on every submesh and its lods. Non-zero for mapped
+    // models, those can't change. Slow on big meshes, so it's for
+    // converting: mod_init, mod_lods, mod_optimize, then mod_store.
+    int mod_optimize(Model *model);
+
+    // msh_lods for every submesh, into SubMesh.lods, before mod_optimize.
+    int mod_lods(Model *model);
+
+    // Poses the bones at time (in seconds) into the animation, blending
+    // between frames, and fills palette for RenderCall.animation. An
+    // animation out of range gives the bind pose.
+    void mod_pose(AnimationState *state, u32 animation, f32 time);
+    void mod_pose_blend(Pose pose);
+
+    // Poses all of them across the worker threads, every state has to be
+    // a different one.
+    void mod_pose_many(Pose *poses, u32 amount);
+
+    // A state of its own for one more character, the skeleton and the
+    // animations stay with the model and it has to outlive this.
+    int mod_animation_new(AnimationState *out, const AnimationState *model);
+    void mod_animation_free(AnimationState *state);
+
+
+// MESH.C ///////////////////////////////////////////////////////
+    u32 msh_triangles(MeshSlice mesh);
+
+    // Turns a mesh into an indexed one where every vertex shows up once,
+    // into new arrays that msh_free lets go of.
+    int msh_weld(MeshSlice *out, MeshSlice in);
+
+    // Reorders the triangles inside each range (in triangles, like
+    // SubMesh.range, NULL is all of them) for the vertex cache and less
+    // overdraw, then the vertices in the order they get used. Changes the
+    // arrays in place, so it needs the whole mesh, not a mod_submesh slice.
+    int msh_optimize(MeshSlice *mesh, const Range *ranges, u32 range_amount);
+
+    // Simpler versions of the triangles in range, about half as many each
+    // time, made by moving vertices onto their neighbours (quadric error
+    // metrics), so they use the same vertices. Open edges and uv seams
+    // stay. They go after the indices (lod_index_amount grows, the array
+    // gets reallocated) and lods gets their ranges.
+    int msh_lods(MeshSlice *mesh, Range range, Lods *lods);
+    void msh_free(MeshSlice *mesh);
+
 
 // AUDIO.C //////////////////////////////////////////////////////
     enum {
@@ -178,6 +344,7 @@ void err_fatal(const char *title, const char *format, ...);
     typedef u32 Source; // Sound source (spatial)
 
     int aud_load_ogg(Sound *sound, const u8 *mem, u32 length, bool spatialize);
+    void aud_unload(Sound sound);
     int aud_init_source(Source *source, Sound audio);
     void aud_free(Source audio);
     void aud_play(Source audio);
@@ -200,6 +367,16 @@ void err_fatal(const char *title, const char *format, ...);
     #ifdef BASKET_INTERNAL
         int aud_init();
         int aud_byebye();
+
+        // aud_load_ogg in two halves, for asset.c
+        typedef struct {
+            short *samples;
+            u32 amount;
+            int channels, sample_rate;
+        } DecodedSound;
+
+        int aud_decode_ogg(DecodedSound *out, const u8 *mem, u32 length, bool spatialize);
+        int aud_upload(Sound *sound, DecodedSound *decoded);
     #endif
 
 
@@ -209,9 +386,65 @@ void err_fatal(const char *title, const char *format, ...);
         u16 w, h;
     } Image;
 
+    typedef struct {
+        u16 x, y, w, h;
+    } TextureSlice;
+
+    enum {
+        IMG_FORMAT_RGBA8 = 0,
+        IMG_FORMAT_BC1,
+        IMG_FORMAT_BC3
+    };
+
+    // The first level of a BC1/BC3 DDS as it is, blocks point into the data
+    typedef struct {
+        const u8 *blocks;
+        u32 size;
+        u16 w, h;
+        u8 format;
+    } CompressedImage;
+
+    // DDS (BC1/BC3) gets decoded on the CPU, anything else goes to stb_image
     int img_init(Image *image, const char *data, u32 length);
     void img_free(Image *image);
 
+    // Just the size, without decoding anything
+    int img_info(const char *data, u32 length, u16 *w, u16 *h);
+    int img_compressed(CompressedImage *out, const char *data, u32 length);
+
+    // Half the size, for mip levels
+    int img_half(Image *out, Image in);
+
+    // Lots of small images in one big one, so they can share a texture
+    // (and a draw). Packed with a skyline, image.pixels is owned by it.
+    typedef struct {
+        u16 x, y, w;
+    } AtlasSegment;
+
+    typedef struct {
+        Image image;
+        AtlasSegment *skyline;
+        u32 segments;
+    } Atlas;
+
+    int img_atlas_init(Atlas *atlas, u16 w, u16 h);
+    void img_atlas_free(Atlas *atlas);
+
+    // Copies image in, out gets where it ended up. Non-zero if it's full.
+    int img_atlas_add(Atlas *atlas, Image image, TextureSlice *out);
+
+    // Tallest first, packs a lot tighter than adding them one by one.
+    // Returns how many made it, slices of the ones that didn't stay zeroed.
+    u32 img_atlas_pack(Atlas *atlas, const Image *images, u32 amount, TextureSlice *out);
+
+    // For building packages offline, stores <name>.tga and <name>.slices
+    // in package. ren_tex_load takes the first, img_atlas_slices the other.
+    int img_atlas_store(
+        const Atlas *atlas, const TextureSlice *slices, u32 amount,
+        const char *package, const char *name
+    );
+    u32 img_atlas_slices(const char *data, u32 length, TextureSlice *out, u32 capacity);
+
 
 // FONT.C ///////////////////////////////////////////////////////
     // INFO: WORK IN PROGRESS!
@@ -266,6 +499,9 @@ void err_fatal(const char *title, const char *format, ...);
     void mat4_from_quaternion(f32 out[16], const f32 quat[4]);
     void mat4_from_transform(f32 out[16], Transform transform);
 
+    void quat_nlerp(f32 out[4], const f32 a[4], const f32 b[4], f32 t);
+    void transform_lerp(Transform *out, const Transform *a, const Transform *b, f32 t);
+
     f32 vec_dot(const f32 *a, const f32 *b, int len);
     f32 vec_len(const f32 *in, int len);
     void vec_min(f32 *out, const f32 *a, const f32 *b, int len);
@@ -285,27 +521,38 @@ void err_fatal(const char *title, const char *format, ...);
 
 
 // POOL.C ///////////////////////////////////////////////////////
-typedef struct VertexPool VertexPool;
+typedef struct {
+    Box bounds;
+    u32 first, amount; // the triangles under this node
+    u32 left;          // 0 on leaves, the right child is left+1
+} PoolNode;
 
-struct VertexPool {
-    VertexPool* left;
-    VertexPool* right;
+typedef struct {
+    PoolNode* nodes; // nodes[0] is the root
+    u32 node_amount;
 
-    Box bounds;
-    Triangle* triangles;
+    Triangle* triangles; // sorted in place by pool_init, not owned
     u32 triangle_count;
-};
+} VertexPool;
 
+// Takes a triangle soup, indexed meshes have to be unwelded first.
 int pool_init(VertexPool* pool, Triangle* triangles, u32 count);
-void pool_free(VertexPool* node);
+void pool_free(VertexPool* pool);
+
+// Both write up to capacity triangle ranges into out, and return how
+// many. Once out is full the last range grows over the rest, so nothing
+// gets dropped. They index the sorted soup, so they only go straight into
+// RenderCall.range when the call draws that soup without indices.
+u32 pool_frustum(VertexPool* pool, Frustum frustum, Range* out, u32 capacity);
+u32 pool_overlap(VertexPool* pool, Box box, Range* out, u32 capacity);
+
+// distance and triangle can be NULL
+bool pool_raycast(VertexPool* pool, f32 origin[3], f32 direction[3], f32* distance, u32* triangle);
 
 
 // RENDERER.C ///////////////////////////////////////////////////
     typedef u8 Texture;
-
-    typedef struct {
-        u16 x, y, w, h;
-    } TextureSlice;
+    typedef u16 Buffer; // A mesh living on the GPU, see ren_buf_load
 
     typedef struct {
         f32 position[3];
@@ -317,16 +564,28 @@ void pool_free(VertexPool* node);
         f32 model[16];
         Color tint;
         MeshSlice mesh;
+        Buffer buffer; // If set, draws this instead of uploading mesh
+        Texture image, lumos; // If both 0, whatever ren_tex_bind had
         TextureSlice texture;
         AnimationState *animation;
         Range range;
+        // If set, picks range from these by distance. They go with the
+        // whole mesh they were made for, not a mod_submesh slice of it,
+        // and get ignored when they don't fit the mesh or buffer.
+        const Lods *lods;
     } RenderCall;
 
+    typedef struct {
+        f32 model[16];
+        Color tint;
+    } Instance;
+
     typedef struct {
         f32 position[2];
         f32 scale[2];
         TextureSlice texture;
         Color color;
+        Texture image; // If 0, whatever ren_tex_bind had
     } Quad;
 
     #define DEFAULT_QUAD (Quad){ { 0.0, 0.0 }, { 1.0, 1.0 }, { 0, 0, 0, 0 }, COLOR_WHITE }
@@ -337,11 +596,19 @@ void pool_free(VertexPool* node);
     RenderCall *ren_render(RenderCall call);
     void ren_light(Light);
 
+    // Draws call once per instance, with the instance's model and tint
+    // instead of the call's. Only calls with a buffer get drawn instanced,
+    // the rest turn into one regular call per instance.
+    void ren_render_instanced(RenderCall call, const Instance *instances, u32 amount);
+
     RenderCall *ren_draw(RenderCall call);
     void ren_quad(Quad quad);
     void ren_rect(i32 x, i32 y, u32 w, u32 h, Color color);
 
     void ren_camera(f32 from[3], f32 to[3], f32 up[3]);
+
+    // the camera frustum in the space of model, for pool_frustum
+    void ren_frustum(Frustum *out, f32 model[16]);
     void ren_far(f32 far, Color clear);
     void ren_ambient(Color ambient);
     void ren_snapping(u8 snap);
@@ -351,11 +618,33 @@ void pool_free(VertexPool* node);
     void ren_mouse_position(i16 *x, i16 *y);
     void ren_videomode(u16 w, u16 h, bool force_ratio);
 
+    // BC1/BC3 DDS files go up as they are when the GPU can take them
     Texture ren_tex_load(const char *data, u32 length);
     Texture ren_tex_load_custom(Image image);
     void ren_tex_free(Texture id);
+
+    // Whether BC1/BC3 DDS files can go up without decoding them first.
+    // Fine to ask from any thread once ren_init is done.
+    bool ren_tex_compressed(void);
+
+    // Returns right away, decoding happens on a worker and the image shows
+    // up over the next few frames, blurry first. Slices work from the start.
+    Texture ren_tex_stream(const char *data, u32 length);
+
+    // False while a streamed texture is still on its way, and for good
+    // once it failed to decode (it stays empty, ren_tex_failed says so).
+    bool ren_tex_ready(Texture id);
+    bool ren_tex_failed(Texture id);
     void ren_tex_bind(Texture main, Texture lumos);
 
+    Buffer ren_buf_load(MeshSlice mesh);
+
+    // Like ren_buf_load, in a third less memory: positions in 16 bits
+    // inside mesh.box, uvs in 16 bits inside the mesh's uv range. Steps
+    // are box size / 65535, so it's for props more than whole levels.
+    Buffer ren_buf_load_packed(MeshSlice mesh);
+    void ren_buf_free(Buffer id);
+
     #ifdef BASKET_INTERNAL
         int ren_init(SDL_Window *window);
         int ren_frame();
@@ -363,6 +652,51 @@ void pool_free(VertexPool* node);
     #endif
 
 
+// ASSET.C //////////////////////////////////////////////////////
+    // Loads things from the package on the workers, the parts that need
+    // the main thread (uploads) happen a few per frame in ast_frame.
+    typedef u32 Asset;
+
+    enum {
+        AST_KIND_FILE = 0, // just the bytes, like pak_read
+        AST_KIND_TEXTURE,
+        AST_KIND_MODEL,
+        AST_KIND_SOUND,
+        AST_KIND_FONT
+    };
+
+    enum {
+        AST_STATE_NONE = 0, // not an asset
+        AST_STATE_LOADING,
+        AST_STATE_READY,
+        AST_STATE_FAILED
+    };
+
+    typedef struct {
+        u8 kind;
+        bool spatialize; // sounds
+        f32 size;        // fonts
+    } AssetRequest;
+
+    Asset ast_load(const char *path, AssetRequest request);
+    int ast_state(Asset asset);
+    void ast_free(Asset asset);
+
+    // Zero/NULL until it's ready, pointers stay good until ast_free (and
+    // ast_file's until a different package gets mounted too)
+    const char *ast_file(Asset asset, size_t *size);
+    Texture ast_texture(Asset asset);
+    Model *ast_model(Asset asset);
+    Sound ast_sound(Asset asset);
+    Font *ast_font(Asset asset);
+
+    #ifdef BASKET_INTERNAL
+        int ast_init();
+        void ast_frame();
+        void ast_byebye();
+    #endif
+
+
 // INPUT.C //////////////////////////////////////////////////////
     enum {
         INP_NONE = 0,
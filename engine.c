@@ -121,11 +121,19 @@ static int eng_headless(Application app) {
 
     eng_tickrate(30);
 
+    if (job_init())
+        ERR_FATAL("couldn't init workers!");
+
+    if (ast_init())
+        ERR_FATAL("couldn't init the asset loader!");
+
     ENG_CALL_IF_VALID(app.init, app.userdata);
 
     while (running) {
         uint64_t frame_start = SDL_GetPerformanceCounter();
 
+        ast_frame();
+
         ENG_CALL_IF_VALID(app.tick, app.userdata, 1.0/hz);
 
         uint64_t frame_end = SDL_GetPerformanceCounter();
@@ -142,6 +150,9 @@ static int eng_headless(Application app) {
 
     ENG_CALL_IF_VALID(app.close, app.userdata, ret);
 
+    ast_byebye();
+    job_byebye();
+
     return ret;
 }
 
@@ -174,6 +185,10 @@ int eng_main(Application app, bool headless) {
     if (window == NULL)
         ERR_FATAL("can't initialize window\n%s", SDL_GetError());
 
+    // workers.
+    if (job_init())
+        ERR_FATAL("couldn't init workers!");
+
     // audio.
     if (aud_init())
         ERR_FATAL("couldn't init audio!");
@@ -186,6 +201,10 @@ int eng_main(Application app, bool headless) {
     if (inp_init())
         ERR_FATAL("couldn't init input!");
 
+    // assets, after everything they upload to.
+    if (ast_init())
+        ERR_FATAL("couldn't init the asset loader!");
+
     inp_bind((RawBindings) {
         .up     = (char *[]) {"w", 0},
         .down   = (char *[]) {"s", 0},
@@ -298,6 +317,8 @@ int eng_main(Application app, bool headless) {
             ren_rect(-(i32)(w/2), -(i32)(w/2), h*2, h*2, (Color){ .full = 0x00000055 });
         }
 
+        ast_frame();
+
         if (ren_frame())
             ERR_FATAL("renderer fuckup! sorry");
 
@@ -307,6 +328,9 @@ int eng_main(Application app, bool headless) {
     if (app.close)
         ret = app.close(app.userdata, ret);
 
+    printf("[OFFLINE] hippocampus\n");
+    ast_byebye();
+
     printf("[OFFLINE] cerebellum\n");
     inp_byebye();
 
@@ -316,6 +340,9 @@ int eng_main(Application app, bool headless) {
     printf("[OFFLINE] occipital lobe\n");
     ren_byebye();
 
+    printf("[OFFLINE] spinal cord\n");
+    job_byebye();
+
     printf("[OFFLINE] frontal lobe\n");
     SDL_DestroyWindow(window);
 
@@ -8,7 +8,7 @@
 int fnt_init(Font *font, const char* data, u32 length, float size) {
     ttf_t* ttf;
     if (ttf_load_from_mem((u8 *)data, length, &ttf, false) != TTF_DONE) {
-        return 0;
+        return 1;
     }
 
     Glyph *array = calloc(sizeof(Glyph), ttf->nchars);
@@ -1,9 +1,192 @@
 #include "basket.h"
 #include "lib/stb_image.h"
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// DDS
+
+// just enough of the DDS header to find BC1/BC3 blocks, plain and DX10
+#define DDS_HEADER 128
+#define DDS_DX10_HEADER 20
+
+static u32 get_u32(const u8 *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((u32)in[3] << 24);
+}
+
+int img_compressed(CompressedImage *out, const char *data, u32 length) {
+    const u8 *in = (const u8 *)data;
+
+    if (!data || length < DDS_HEADER || memcmp(in, "DDS ", 4))
+        return 1;
+
+    u32 offset = DDS_HEADER;
+    u32 fourcc = get_u32(&in[84]);
+
+    u32 h = get_u32(&in[12]);
+    u32 w = get_u32(&in[16]);
+
+    // they have to fit the u16s
+    if (!w || !h || w > 0xFFFF || h > 0xFFFF)
+        return 1;
+
+    *out = (CompressedImage) { .w = w, .h = h };
+
+    if (fourcc == get_u32((const u8 *)"DXT1")) {
+        out->format = IMG_FORMAT_BC1;
+    } else if (fourcc == get_u32((const u8 *)"DXT5")) {
+        out->format = IMG_FORMAT_BC3;
+    } else if (fourcc == get_u32((const u8 *)"DX10") && length >= DDS_HEADER + DDS_DX10_HEADER) {
+        u32 dxgi = get_u32(&in[DDS_HEADER]);
+        offset += DDS_DX10_HEADER;
+
+        // UNORM and SRGB, we don't care about the difference
+        if (dxgi == 71 || dxgi == 72)
+            out->format = IMG_FORMAT_BC1;
+        else if (dxgi == 77 || dxgi == 78)
+            out->format = IMG_FORMAT_BC3;
+        else
+            return 1;
+    } else {
+        return 1;
+    }
+
+    u64 block = out->format == IMG_FORMAT_BC1 ? 8 : 16;
+    u64 size = (u64)((w + 3) / 4) * ((h + 3) / 4) * block;
+
+    // only the first level is used, the rest of the mips can go
+    if (size > length - offset)
+        return 1;
+
+    out->size = size;
+
+    out->blocks = &in[offset];
+
+    return 0;
+}
+
+static void color_565(u8 out[4], u16 color) {
+    out[0] = ((color >> 11) & 0x1F) * 255 / 31;
+    out[1] = ((color >> 5)  & 0x3F) * 255 / 63;
+    out[2] = ( color        & 0x1F) * 255 / 31;
+    out[3] = 255;
+}
+
+// 16 rgba pixels out of a BC1 color block. BC3 always uses 4 colors.
+static void decode_colors(u8 out[16][4], const u8 *block, bool four_colors) {
+    u16 c0 = block[0] | (block[1] << 8);
+    u16 c1 = block[2] | (block[3] << 8);
+    u8 palette[4][4];
+
+    color_565(palette[0], c0);
+    color_565(palette[1], c1);
+
+    for (int k = 0; k < 3; k++) {
+        if (four_colors || c0 > c1) {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        } else {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+
+    palette[2][3] = 255;
+    palette[3][3] = (four_colors || c0 > c1) ? 255 : 0;
+
+    u32 indices = get_u32(&block[4]);
+
+    for (int i = 0; i < 16; i++)
+        memcpy(out[i], palette[(indices >> (i*2)) & 3], 4);
+}
+
+static void decode_alpha(u8 out[16][4], const u8 *block) {
+    u8 palette[8] = { block[0], block[1] };
+
+    if (palette[0] > palette[1]) {
+        for (int i = 1; i < 7; i++)
+            palette[i+1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+    } else {
+        for (int i = 1; i < 5; i++)
+            palette[i+1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    // 48 bits of 3 bit indices
+    u64 indices = 0;
+    for (int i = 0; i < 6; i++)
+        indices |= (u64)block[2 + i] << (i*8);
+
+    for (int i = 0; i < 16; i++)
+        out[i][3] = palette[(indices >> (i*3)) & 7];
+}
+
+// the cpu fallback for when the gpu can't take the blocks as they are
+static int decode_compressed(Image *image, const CompressedImage *compressed) {
+    const u32 w = compressed->w, h = compressed->h;
+    const u32 block_size = compressed->format == IMG_FORMAT_BC1 ? 8 : 16;
+
+    image->pixels = malloc(sizeof(Color) * w * h);
+    if (!image->pixels)
+        return 1;
+
+    image->w = w;
+    image->h = h;
+
+    const u8 *block = compressed->blocks;
+
+    for (u32 by = 0; by < h; by += 4) {
+        for (u32 bx = 0; bx < w; bx += 4, block += block_size) {
+            u8 texels[16][4];
+
+            if (compressed->format == IMG_FORMAT_BC1) {
+                decode_colors(texels, block, false);
+            } else {
+                decode_colors(texels, &block[8], true);
+                decode_alpha(texels, block);
+            }
+
+            // blocks hang over the edge of sizes that aren't a multiple of 4
+            for (u32 y = 0; y < 4 && by + y < h; y++)
+                for (u32 x = 0; x < 4 && bx + x < w; x++)
+                    memcpy(image->pixels[(by + y) * w + bx + x].array, texels[y*4 + x], 4);
+        }
+    }
+
+    return 0;
+}
+
+
+int img_info(const char *data, u32 length, u16 *w, u16 *h) {
+    CompressedImage compressed;
+
+    if (!img_compressed(&compressed, data, length)) {
+        *w = compressed.w;
+        *h = compressed.h;
+        return 0;
+    }
+
+    int iw, ih, c;
+    if (!stbi_info_from_memory((const stbi_uc *)data, length, &iw, &ih, &c))
+        return 1;
+
+    *w = iw;
+    *h = ih;
+
+    return 0;
+}
+
 int img_init(Image *texture, const char *data, u32 length) {
     int w, h, c;
 
+    CompressedImage compressed;
+    if (!img_compressed(&compressed, data, length))
+        return decode_compressed(texture, &compressed);
+
     // TODO: HANDLE OTHER CASES(? :O
     texture->pixels = (Color *)stbi_load_from_memory (
         (const stbi_uc *)data, length, &w, &h, &c, 4
@@ -21,6 +204,34 @@ int img_init(Image *texture, const char *data, u32 length) {
     return 0;
 }
 
+// 2x2 box filter, odd sizes lose their last row/column
+int img_half(Image *out, Image in) {
+    *out = (Image) { 0 };
+
+    if (!in.pixels || in.w < 2 || in.h < 2)
+        return 1;
+
+    out->w = in.w / 2;
+    out->h = in.h / 2;
+    out->pixels = malloc(sizeof(Color) * out->w * out->h);
+
+    if (!out->pixels)
+        return 1;
+
+    for (u32 y = 0; y < out->h; y++) {
+        for (u32 x = 0; x < out->w; x++) {
+            const Color *a = &in.pixels[(y*2) * in.w + x*2];
+            const Color *b = a + in.w;
+            Color *pixel = &out->pixels[y * out->w + x];
+
+            for (int k = 0; k < 4; k++)
+                pixel->array[k] = (a[0].array[k] + a[1].array[k] + b[0].array[k] + b[1].array[k] + 2) / 4;
+        }
+    }
+
+    return 0;
+}
+
 void img_free(Image *texture) {
     if (texture->pixels) {
         stbi_image_free(texture->pixels);
@@ -29,4 +240,293 @@ void img_free(Image *texture) {
     texture->pixels = NULL;
     texture->w = 0;
     texture->h = 0;
-}
\ No newline at end of file
+}
+
+// ATLAS
+
+#define ATLAS_PADDING 1 // keeps neighbours from bleeding in
+
+int img_atlas_init(Atlas *atlas, u16 w, u16 h) {
+    *atlas = (Atlas) { 0 };
+
+    if (!w || !h)
+        return 1;
+
+    atlas->image.pixels = calloc((size_t)w * h, sizeof(Color));
+
+    // there can't be more segments than columns
+    atlas->skyline = malloc(sizeof(AtlasSegment) * w);
+
+    if (!atlas->image.pixels || !atlas->skyline) {
+        img_atlas_free(atlas);
+        return 1;
+    }
+
+    atlas->image.w = w;
+    atlas->image.h = h;
+
+    atlas->skyline[0] = (AtlasSegment) { 0, 0, w };
+    atlas->segments = 1;
+
+    return 0;
+}
+
+void img_atlas_free(Atlas *atlas) {
+    if (atlas->image.pixels)
+        free(atlas->image.pixels);
+
+    if (atlas->skyline)
+        free(atlas->skyline);
+
+    *atlas = (Atlas) { 0 };
+}
+
+// how high something w wide sits when its left edge is at segment index,
+// or -1 if it goes past the edges
+static i32 skyline_fits(Atlas *atlas, u32 index, u32 w, u32 h) {
+    AtlasSegment *skyline = atlas->skyline;
+    u32 x = skyline[index].x;
+
+    if (x + w > atlas->image.w)
+        return -1;
+
+    u32 y = 0;
+    for (u32 left = w; left > 0; index++) {
+        y = max(y, skyline[index].y);
+
+        if (y + h > atlas->image.h)
+            return -1;
+
+        left -= min(left, skyline[index].w);
+    }
+
+    return y;
+}
+
+static void skyline_place(Atlas *atlas, u32 index, u32 x, u32 y, u32 w) {
+    AtlasSegment *skyline = atlas->skyline;
+
+    // the new segment covers whatever it sits on
+    u32 end = x + w;
+    u32 last = index;
+
+    while (last < atlas->segments && skyline[last].x + skyline[last].w <= end)
+        last++;
+
+    // one partly under it gets cut down to what's left sticking out
+    if (last < atlas->segments && skyline[last].x < end) {
+        skyline[last].w -= end - skyline[last].x;
+        skyline[last].x = end;
+    }
+
+    memmove(
+        &skyline[index + 1], &skyline[last],
+        (atlas->segments - last) * sizeof(AtlasSegment)
+    );
+
+    atlas->segments = atlas->segments - (last - index) + 1;
+    skyline[index] = (AtlasSegment) { x, y, w };
+
+    // same heights next to each other become one
+    for (u32 i = 0; i + 1 < atlas->segments;) {
+        if (skyline[i].y != skyline[i+1].y) {
+            i++;
+            continue;
+        }
+
+        skyline[i].w += skyline[i+1].w;
+
+        memmove(
+            &skyline[i + 1], &skyline[i + 2],
+            (atlas->segments - i - 2) * sizeof(AtlasSegment)
+        );
+
+        atlas->segments--;
+    }
+}
+
+int img_atlas_add(Atlas *atlas, Image image, TextureSlice *out) {
+    if (!atlas->image.pixels || !image.pixels)
+        return 1;
+
+    u32 w = image.w + ATLAS_PADDING;
+    u32 h = image.h + ATLAS_PADDING;
+
+    // lowest top wins, the narrower spot if that's a tie
+    i32 best = -1;
+    u32 best_top = UINT32_MAX, best_width = UINT32_MAX;
+
+    for (u32 i = 0; i < atlas->segments; i++) {
+        i32 y = skyline_fits(atlas, i, w, h);
+
+        if (y < 0)
+            continue;
+
+        u32 top = y + h;
+        if (top < best_top || (top == best_top && atlas->skyline[i].w < best_width)) {
+            best = i;
+            best_top = top;
+            best_width = atlas->skyline[i].w;
+        }
+    }
+
+    if (best < 0)
+        return 1;
+
+    u32 x = atlas->skyline[best].x;
+    u32 y = best_top - h;
+
+    for (u32 row = 0; row < image.h; row++)
+        memcpy(
+            &atlas->image.pixels[(y + row) * atlas->image.w + x],
+            &image.pixels[row * image.w],
+            image.w * sizeof(Color)
+        );
+
+    skyline_place(atlas, best, x, best_top, w);
+
+    if (out)
+        *out = (TextureSlice) { x, y, image.w, image.h };
+
+    return 0;
+}
+
+static const Image *sort_images;
+
+static int taller_first(const void *a, const void *b) {
+    const Image *ia = &sort_images[*(const u32 *)a];
+    const Image *ib = &sort_images[*(const u32 *)b];
+
+    if (ia->h != ib->h)
+        return ia->h < ib->h ? 1 : -1;
+
+    if (ia->w != ib->w)
+        return ia->w < ib->w ? 1 : -1;
+
+    return *(const u32 *)a < *(const u32 *)b ? -1 : 1;
+}
+
+u32 img_atlas_pack(Atlas *atlas, const Image *images, u32 amount, TextureSlice *out) {
+    u32 *order = malloc(sizeof(u32) * amount);
+    if (!order)
+        return 0;
+
+    for (u32 i = 0; i < amount; i++) {
+        order[i] = i;
+        out[i] = (TextureSlice) { 0 };
+    }
+
+    sort_images = images;
+    qsort(order, amount, sizeof(u32), taller_first);
+    sort_images = NULL;
+
+    u32 packed = 0;
+    for (u32 i = 0; i < amount; i++) {
+        if (!img_atlas_add(atlas, images[order[i]], &out[order[i]]))
+            packed++;
+    }
+
+    free(order);
+
+    return packed;
+}
+
+static void put_u16(u8 *out, u16 value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static u16 get_u16(const u8 *in) {
+    return in[0] | (in[1] << 8);
+}
+
+// uncompressed 32 bit TGA, the package does the compressing anyways
+static int store_tga(const Image *image, const char *package, const char *name) {
+    const u32 pixels = image->w * image->h;
+    const u32 size = 18 + pixels * 4;
+
+    u8 *data = calloc(size, 1);
+    if (!data)
+        return 1;
+
+    data[2] = 2; // truecolor
+    put_u16(&data[12], image->w);
+    put_u16(&data[14], image->h);
+    data[16] = 32;
+    data[17] = 0x28; // 8 alpha bits, top to bottom
+
+    for (u32 i = 0; i < pixels; i++) {
+        const u8 *rgba = image->pixels[i].array;
+        u8 *bgra = &data[18 + i*4];
+
+        bgra[0] = rgba[2];
+        bgra[1] = rgba[1];
+        bgra[2] = rgba[0];
+        bgra[3] = rgba[3];
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.tga", name);
+
+    int result = pak_store(package, path, (const char *)data, size);
+    free(data);
+
+    return result;
+}
+
+// u32 amount, then x, y, w, h for every slice, all little endian
+int img_atlas_store(
+    const Atlas *atlas, const TextureSlice *slices, u32 amount,
+    const char *package, const char *name
+) {
+    if (!atlas->image.pixels || store_tga(&atlas->image, package, name))
+        return 1;
+
+    const u32 size = 4 + amount * 8;
+
+    u8 *data = malloc(size);
+    if (!data)
+        return 1;
+
+    put_u16(&data[0], amount & 0xFFFF);
+    put_u16(&data[2], amount >> 16);
+
+    for (u32 i = 0; i < amount; i++) {
+        u8 *slice = &data[4 + i*8];
+
+        put_u16(&slice[0], slices[i].x);
+        put_u16(&slice[2], slices[i].y);
+        put_u16(&slice[4], slices[i].w);
+        put_u16(&slice[6], slices[i].h);
+    }
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.slices", name);
+
+    int result = pak_store(package, path, (const char *)data, size);
+    free(data);
+
+    return result;
+}
+
+u32 img_atlas_slices(const char *data, u32 length, TextureSlice *out, u32 capacity) {
+    const u8 *in = (const u8 *)data;
+
+    if (!data || length < 4)
+        return 0;
+
+    u32 amount = get_u16(&in[0]) | ((u32)get_u16(&in[2]) << 16);
+    amount = min(amount, (length - 4) / 8);
+    amount = min(amount, capacity);
+
+    for (u32 i = 0; i < amount; i++) {
+        const u8 *slice = &in[4 + i*8];
+
+        out[i] = (TextureSlice) {
+            get_u16(&slice[0]), get_u16(&slice[2]),
+            get_u16(&slice[4]), get_u16(&slice[6])
+        };
+    }
+
+    return amount;
+}
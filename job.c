@@ -0,0 +1,241 @@
+// a tiny worker pool, so the other cores get to do something too.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_cpuinfo.h>
+
+#define BASKET_INTERNAL
+#include "basket.h"
+
+#define MAX_WORKERS 15
+
+typedef struct Batch Batch;
+
+struct Batch {
+    JobFunction function;
+    void *userdata;
+
+    u32 amount;
+    u32 next; // next index nobody claimed yet
+    u32 done;
+
+    bool detached; // nobody waits for it, whoever finishes it frees it
+
+    Batch *link;
+};
+
+// everything below is guarded by lock
+static SDL_mutex *lock;
+static SDL_cond *wake;
+static SDL_cond *finished;
+
+static Batch *first, *last;
+static bool quitting;
+
+static SDL_Thread *workers[MAX_WORKERS];
+static u32 worker_amount;
+
+static void unlink_batch(Batch *batch) {
+    Batch **it = &first;
+    Batch *previous = NULL;
+
+    while (*it && *it != batch) {
+        previous = *it;
+        it = &(*it)->link;
+    }
+
+    if (!*it)
+        return;
+
+    *it = batch->link;
+
+    if (last == batch)
+        last = previous;
+}
+
+static bool claim(Batch *batch, u32 *index) {
+    if (batch->next >= batch->amount)
+        return false;
+
+    *index = batch->next++;
+
+    if (batch->next == batch->amount)
+        unlink_batch(batch);
+
+    return true;
+}
+
+// the batch may be gone as soon as the last index is marked done
+static void mark_done(Batch *batch) {
+    if (batch->detached) {
+        if (++batch->done == batch->amount)
+            free(batch);
+
+        return;
+    }
+
+    if (++batch->done == batch->amount)
+        SDL_CondBroadcast(finished);
+}
+
+static int worker(void *data) {
+    (void)data;
+
+    SDL_LockMutex(lock);
+
+    // pushed jobs still get done before quitting, something may be
+    // waiting on them
+    while (!quitting || first) {
+        if (!first) {
+            SDL_CondWait(wake, lock);
+            continue;
+        }
+
+        Batch *batch = first;
+        u32 index;
+
+        if (!claim(batch, &index))
+            continue;
+
+        SDL_UnlockMutex(lock);
+        batch->function(batch->userdata, index);
+        SDL_LockMutex(lock);
+
+        mark_done(batch);
+    }
+
+    SDL_UnlockMutex(lock);
+
+    return 0;
+}
+
+int job_init() {
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+    finished = SDL_CreateCond();
+
+    if (!lock || !wake || !finished)
+        return 1;
+
+    int amount = SDL_GetCPUCount() - 1;
+
+    if (getenv("BK_WORKERS"))
+        amount = atoi(getenv("BK_WORKERS"));
+
+    amount = clamp(amount, 0, MAX_WORKERS);
+
+    printf("setting up %i workers.\n", amount);
+
+    quitting = false;
+    for (int i = 0; i < amount; i++) {
+        workers[worker_amount] = SDL_CreateThread(worker, "basket worker", NULL);
+
+        if (workers[worker_amount])
+            worker_amount++;
+    }
+
+    return 0;
+}
+
+void job_byebye() {
+    if (!lock) return;
+
+    SDL_LockMutex(lock);
+    quitting = true;
+    SDL_CondBroadcast(wake);
+    SDL_UnlockMutex(lock);
+
+    for (u32 i = 0; i < worker_amount; i++)
+        SDL_WaitThread(workers[i], NULL);
+
+    worker_amount = 0;
+
+    SDL_DestroyCond(finished);
+    SDL_DestroyCond(wake);
+    SDL_DestroyMutex(lock);
+
+    lock = NULL;
+}
+
+u32 job_workers(void) {
+    return worker_amount;
+}
+
+void job_push(JobFunction function, void *userdata) {
+    if (!worker_amount) {
+        function(userdata, 0);
+        return;
+    }
+
+    Batch *batch = malloc(sizeof(Batch));
+    if (!batch) {
+        function(userdata, 0);
+        return;
+    }
+
+    *batch = (Batch) {
+        .function = function,
+        .userdata = userdata,
+        .amount = 1,
+        .detached = true,
+    };
+
+    SDL_LockMutex(lock);
+
+    if (last)
+        last->link = batch;
+    else
+        first = batch;
+
+    last = batch;
+
+    SDL_CondSignal(wake);
+    SDL_UnlockMutex(lock);
+}
+
+void job_parallel(JobFunction function, void *userdata, u32 amount) {
+    if (!amount) return;
+
+    if (!worker_amount || amount == 1) {
+        for (u32 i = 0; i < amount; i++)
+            function(userdata, i);
+
+        return;
+    }
+
+    Batch batch = {
+        .function = function,
+        .userdata = userdata,
+        .amount = amount,
+    };
+
+    SDL_LockMutex(lock);
+
+    if (last)
+        last->link = &batch;
+    else
+        first = &batch;
+
+    last = &batch;
+
+    SDL_CondBroadcast(wake);
+
+    // help out instead of just sitting there
+    u32 index;
+    while (claim(&batch, &index)) {
+        SDL_UnlockMutex(lock);
+        function(userdata, index);
+        SDL_LockMutex(lock);
+
+        batch.done++;
+    }
+
+    while (batch.done < batch.amount)
+        SDL_CondWait(finished, lock);
+
+    SDL_UnlockMutex(lock);
+}
@@ -212,6 +212,7 @@ typedef struct tfx_draw {
 	size_t offset;
 	uint32_t indices;
 	uint32_t depth;
+	uint32_t instances; // 0 counts as 1
 
 	// for compute jobs
 	uint32_t threads_x;
@@ -280,6 +281,7 @@ static tfx_glext available_exts[] = {
 	{ "GL_ARB_seamless_cube_map", false },
 	{ "GL_EXT_texture_filter_anisotropic", false },
 	{ "GL_ARB_multi_bind", false },
+	{ "GL_EXT_texture_compression_s3tc", false },
 	// TODO
 	// GL_AMD_vertex_shader_layer
 	// GL_AMD_vertex_shader_viewport_index
@@ -350,6 +352,7 @@ PFNGLTEXSTORAGE2DPROC tfx_glTexStorage2D;
 PFNGLTEXSTORAGE3DPROC tfx_glTexStorage3D;
 PFNGLTEXSTORAGE2DMULTISAMPLEPROC tfx_glTexStorage2DMultisample;
 PFNGLTEXSUBIMAGE2DPROC tfx_glTexSubImage2D;
+PFNGLCOMPRESSEDTEXIMAGE2DPROC tfx_glCompressedTexImage2D;
 PFNGLTEXSUBIMAGE3DPROC tfx_glTexSubImage3D;
 PFNGLINVALIDATETEXSUBIMAGEPROC tfx_glInvalidateTexSubImage;
 PFNGLGENERATEMIPMAPPROC tfx_glGenerateMipmap;
@@ -465,6 +468,7 @@ void load_em_up(void* (*get_proc_address)(const char*)) {
 	tfx_glTexStorage3D = get_proc_address("glTexStorage3D");
 	tfx_glTexStorage2DMultisample = get_proc_address("glTexStorage2DMultisample");
 	tfx_glTexSubImage2D = get_proc_address("glTexSubImage2D");
+	tfx_glCompressedTexImage2D = get_proc_address("glCompressedTexImage2D");
 	tfx_glTexSubImage3D = get_proc_address("glTexSubImage3D");
 	tfx_glInvalidateTexSubImage = get_proc_address("glInvalidateTexSubImage");
 	tfx_glGenerateMipmap = get_proc_address("glGenerateMipmap");
@@ -641,6 +645,7 @@ tfx_caps tfx_get_caps() {
 	caps.seamless_cubemap = available_exts[8].supported || gl32;
 	caps.anisotropic_filtering = available_exts[9].supported || gl46;
 	caps.multibind = available_exts[10].supported || gl44;
+	caps.texture_s3tc = available_exts[11].supported && tfx_glCompressedTexImage2D;
 
 	g_max_aniso = 0.0f;
 	GLenum GL_TEXTURE_MAX_ANISOTROPY_EXT = 0x84FE;
@@ -1734,6 +1739,7 @@ tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void
 	// TODO: add some stencil formats (i.e. D24S8)
 	bool stencil = false;
 	bool depth = false;
+	uint32_t block_size = 0; // bytes per 4x4 block, for compressed formats
 	switch (format) {
 		// integer formats
 		case TFX_FORMAT_RGB565:
@@ -1827,6 +1833,19 @@ tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void
 			params->type = GL_FLOAT;
 			depth = true;
 			break;
+		// compressed formats
+		case TFX_FORMAT_BC1:
+			params->format = GL_RGBA;
+			params->internal_format = 0x83F1; // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+			params->type = GL_UNSIGNED_BYTE;
+			block_size = 8;
+			break;
+		case TFX_FORMAT_BC3:
+			params->format = GL_RGBA;
+			params->internal_format = 0x83F3; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+			params->type = GL_UNSIGNED_BYTE;
+			block_size = 16;
+			break;
 		// invalid
 		case TFX_FORMAT_RGB565_D16:
 		case TFX_FORMAT_RGBA8_D16:
@@ -1959,6 +1978,13 @@ tfx_texture tfx_texture_new(uint16_t w, uint16_t h, uint16_t layers, const void
 				}
 			}
 		}
+		else if (block_size) {
+			// no mips, no updates, no cubes. just the one level as it came.
+			assert(layers == 1 && !mip_filter && t.gl_count == 1);
+			assert(tfx_glCompressedTexImage2D && data);
+			GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+			CHECK(tfx_glCompressedTexImage2D(mode, 0, params->internal_format, w, h, 0, size, data));
+		}
 		else if (tfx_glTexStorage2D) {
 			CHECK(tfx_glTexStorage2D(mode, mip_filter ? t.mip_count : 1, params->internal_format, w, h));
 			if (data) {
@@ -2565,6 +2591,15 @@ void tfx_set_vertices(tfx_buffer *vbo, int count) {
 	}
 }
 
+void tfx_set_vertices_range(tfx_buffer *vbo, int count, int offset) {
+	tfx_set_vertices(vbo, count);
+	g_tmp_draw.offset = offset;
+}
+
+void tfx_set_instances(int count) {
+	g_tmp_draw.instances = count > 0 ? count : 0;
+}
+
 void tfx_set_indices(tfx_buffer *ibo, int count, int offset) {
 	g_tmp_draw.ibo = *ibo;
 	g_tmp_draw.use_ibo = true;
@@ -2602,11 +2637,13 @@ static void push_uniforms(tfx_program program, tfx_draw *add_state) {
 
 		// only record the last update for a given uniform
 		if (!tfx_slookup(found, uniform.name)) {
+			// only what was set, not the whole declared array
+			size_t size = uniform.last_count * uniform_size_for(uniform.type);
 			tfx_uniform found_uniform = uniform;
 			found_uniform.data = g_back.ub_cursor;
-			assert((g_back.ub_cursor + uniform.size - g_back.uniform_buffer) < TFX_UNIFORM_BUFFER_SIZE);
-			memcpy(found_uniform.data, uniform.data, uniform.size);
-			g_back.ub_cursor += uniform.size;
+			assert((g_back.ub_cursor + size - g_back.uniform_buffer) < TFX_UNIFORM_BUFFER_SIZE);
+			memcpy(found_uniform.data, uniform.data, size);
+			g_back.ub_cursor += size;
 
 			tfx_sset(found, uniform.name);
 			sb_push(add_state->uniforms, found_uniform);
@@ -3731,6 +3768,9 @@ tfx_stats tfx_frame() {
 					draw.vbo.format = draw.tvb_fmt;
 					va_offset = draw.offset;
 				}
+				else if (!draw.use_ibo) {
+					va_offset = draw.offset;
+				}
 				tfx_vertex_format *fmt = &draw.vbo.format;
 				assert(fmt != NULL);
 				assert(fmt->stride > 0);
@@ -3831,6 +3871,9 @@ tfx_stats tfx_frame() {
 					}
 				}
 			}
+			if (draw.instances > 1) {
+				instance_mul *= draw.instances;
+			}
 
 			if (draw.use_ibo) {
 				if (draw.ibo.dirty && tfx_glMemoryBarrier) {
@@ -144,6 +144,10 @@ typedef enum tfx_format {
 	TFX_FORMAT_D32,
 	TFX_FORMAT_D32F,
 	//TFX_FORMAT_D24_S8
+
+	// block compressed, check tfx_caps.texture_s3tc first
+	TFX_FORMAT_BC1,
+	TFX_FORMAT_BC3,
 } tfx_format;
 
 typedef unsigned tfx_program;
@@ -285,6 +289,7 @@ typedef struct tfx_caps {
 	bool seamless_cubemap;
 	bool anisotropic_filtering;
 	bool multibind;
+	bool texture_s3tc;
 } tfx_caps;
 
 // TODO
@@ -372,7 +377,11 @@ TFX_API void tfx_set_texture(tfx_uniform *uniform, tfx_texture *tex, uint8_t slo
 TFX_API void tfx_set_buffer(tfx_buffer *buf, uint8_t slot, bool write);
 TFX_API void tfx_set_image(tfx_uniform *uniform, tfx_texture *tex, uint8_t slot, uint8_t mip, bool write);
 TFX_API void tfx_set_vertices(tfx_buffer *vbo, int count);
+// like tfx_set_vertices, but starts drawing at a byte offset into the buffer.
+TFX_API void tfx_set_vertices_range(tfx_buffer *vbo, int count, int offset);
 TFX_API void tfx_set_indices(tfx_buffer *ibo, int count, int offset);
+// draw this many instances of the next submit (times the view's instance mul).
+TFX_API void tfx_set_instances(int count);
 TFX_API void tfx_dispatch(uint8_t id, tfx_program program, uint32_t x, uint32_t y, uint32_t z);
 // TFX_API void tfx_submit_ordered(uint8_t id, tfx_program program, uint32_t depth, bool retain);
 TFX_API void tfx_submit(uint8_t id, tfx_program program, bool retain);
@@ -312,11 +312,56 @@ void mat4_from_euler_angle(f32 out[16], const f32 euler[3]) {
 }
 
 void mat4_from_quaternion(f32 out[16], const f32 quat[4]) {
+	const f32 x = quat[0], y = quat[1], z = quat[2], w = quat[3];
 
+	f32 m[16] = IDENTITY_MATRIX;
+
+	m[0] = 1.0f - 2.0f * (y*y + z*z);
+	m[1] = 2.0f * (x*y + z*w);
+	m[2] = 2.0f * (x*z - y*w);
+
+	m[4] = 2.0f * (x*y - z*w);
+	m[5] = 1.0f - 2.0f * (x*x + z*z);
+	m[6] = 2.0f * (y*z + x*w);
+
+	m[8] = 2.0f * (x*z + y*w);
+	m[9] = 2.0f * (y*z - x*w);
+	m[10] = 1.0f - 2.0f * (x*x + y*y);
+
+	memcpy(out, m, 16 * sizeof(f32));
 }
 
+// scale, then rotate, then translate
 void mat4_from_transform(f32 out[16], const Transform transform) {
+	mat4_from_quaternion(out, transform.rotation);
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			out[r*4 + c] *= transform.scale[r];
+
+	out[12] = transform.position[0];
+	out[13] = transform.position[1];
+	out[14] = transform.position[2];
+}
+
+// takes the short way around, the result is normalized
+void quat_nlerp(f32 out[4], const f32 a[4], const f32 b[4], f32 t) {
+	const f32 sign = vec_dot(a, b, 4) < 0.0f ? -1.0f : 1.0f;
+
+	f32 q[4];
+	for (int i = 0; i < 4; i++)
+		q[i] = a[i] * (1.0f - t) + b[i] * sign * t;
+
+	vec_norm(out, q, 4);
+}
+
+void transform_lerp(Transform *out, const Transform *a, const Transform *b, f32 t) {
+	for (int i = 0; i < 3; i++) {
+		out->position[i] = lerp(a->position[i], b->position[i], t);
+		out->scale[i] = lerp(a->scale[i], b->scale[i], t);
+	}
 
+	quat_nlerp(out->rotation, a->rotation, b->rotation, t);
 }
 
 f32 vec_dot(const f32 *a, const f32 *b, int len) {
@@ -0,0 +1,897 @@
+// mesh helpers: merging the vertices triangle soups repeat, so meshes can
+// be drawn indexed, putting the triangles and vertices into an order the
+// gpu gets through faster, and making simpler versions for far away.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "basket.h"
+
+typedef struct {
+    Vertex vertex;
+    VertexAnim animation;
+} Key;
+
+// FNV-1a over the bytes of a vertex
+static u32 hash_key(const Key *key) {
+    const u8 *bytes = (const u8 *)key;
+    u32 hash = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(Key); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static Key key_of(MeshSlice mesh, u32 index) {
+    Key key;
+
+    // no padding in either, but zero it anyway, it gets hashed
+    memset(&key, 0, sizeof(key));
+    key.vertex = mesh.data[index];
+
+    if (mesh.animation)
+        key.animation = mesh.animation[index];
+
+    return key;
+}
+
+u32 msh_triangles(MeshSlice mesh) {
+    return (mesh.indices ? mesh.index_amount : mesh.length) / 3;
+}
+
+int msh_weld(MeshSlice *out, MeshSlice in) {
+    *out = (MeshSlice) { 0 };
+
+    u32 corners = msh_triangles(in) * 3;
+
+    if (!in.data || !corners)
+        return 1;
+
+    // at most half full
+    u32 capacity = 16;
+    while (capacity < corners * 2)
+        capacity *= 2;
+
+    u32 *table = malloc(sizeof(u32) * capacity); // vertex+1, 0 is empty
+    out->data = malloc(sizeof(Vertex) * corners);
+    out->indices = malloc(sizeof(u32) * corners);
+
+    if (in.animation)
+        out->animation = malloc(sizeof(VertexAnim) * corners);
+
+    if (!table || !out->data || !out->indices || (in.animation && !out->animation)) {
+        free(table);
+        msh_free(out);
+        return 1;
+    }
+
+    memset(table, 0, sizeof(u32) * capacity);
+
+    u32 length = 0;
+
+    for (u32 i = 0; i < corners; i++) {
+        u32 index = in.indices ? in.indices[i] : i;
+
+        if (index >= in.length) {
+            free(table);
+            msh_free(out);
+            return 1;
+        }
+
+        Key key = key_of(in, index);
+        u32 slot = hash_key(&key) & (capacity - 1);
+
+        for (; table[slot]; slot = (slot + 1) & (capacity - 1)) {
+            Key other = key_of(*out, table[slot] - 1);
+
+            if (!memcmp(&key, &other, sizeof(Key)))
+                break;
+        }
+
+        if (!table[slot]) {
+            out->data[length] = key.vertex;
+
+            if (out->animation)
+                out->animation[length] = key.animation;
+
+            table[slot] = ++length;
+        }
+
+        out->indices[i] = table[slot] - 1;
+    }
+
+    free(table);
+
+    // give back what the repeats didn't need
+    Vertex *data = realloc(out->data, sizeof(Vertex) * length);
+    if (data)
+        out->data = data;
+
+    if (out->animation) {
+        VertexAnim *animation = realloc(out->animation, sizeof(VertexAnim) * length);
+        if (animation)
+            out->animation = animation;
+    }
+
+    out->length = length;
+    out->index_amount = corners;
+    out->box = in.box;
+
+    return 0;
+}
+
+// OPTIMIZING
+
+#define CACHE_SIZE 32          // the lru cache the ordering pretends there is
+#define FIFO_SIZE 16           // what the clusters get measured with
+#define OVERDRAW_THRESHOLD 1.05f // how much worse a cluster may be at the cache
+
+// tom forsyth's linear-speed vertex cache optimisation. vertices in the
+// cache and the ones with few triangles left score high, so it finishes
+// things off before moving on.
+static f32 vertex_score(i32 position, u32 valence) {
+    if (!valence)
+        return -1.0f; // nothing left to draw with it
+
+    f32 score = 0.0f;
+
+    if (position >= 0) {
+        // the last triangle's are all the same, it was just drawn
+        if (position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (f32)(position - 3) / (CACHE_SIZE - 3), 1.5f);
+    }
+
+    return score + 2.0f / sqrtf((f32)valence);
+}
+
+typedef struct {
+    u32 *indices;
+    u32 vertex_amount;
+
+    // which triangles use a vertex, offsets[v] to offsets[v+1] in adjacent
+    u32 *offsets;
+    u32 *adjacent;
+
+    u32 *valence;   // triangles left to draw in the range
+    i32 *position;  // in the cache, -1 is not there
+    f32 *score;
+
+    bool *emitted;
+
+    u32 *order;  // the range, reordered
+    u32 *result; // all of them, ranges get written back in here
+} Work;
+
+// which triangles use a vertex, offsets needs vertex_amount+1 and adjacent
+// three per triangle
+static void build_adjacency(const u32 *indices, u32 triangles, u32 vertex_amount, u32 *offsets, u32 *adjacent) {
+    u32 corners = triangles * 3;
+
+    memset(offsets, 0, sizeof(u32) * (vertex_amount + 1));
+
+    // where every vertex's list ends...
+    for (u32 i = 0; i < corners; i++)
+        offsets[indices[i]]++;
+
+    for (u32 v = 1; v < vertex_amount; v++)
+        offsets[v] += offsets[v-1];
+
+    offsets[vertex_amount] = corners;
+
+    // ...and filling from there backwards leaves where it starts
+    for (u32 i = corners; i-- > 0;)
+        adjacent[--offsets[indices[i]]] = i / 3;
+}
+
+static void order_range(Work *work, Range range) {
+    const u32 *indices = work->indices;
+    u32 first = range.offset, last = range.offset + range.length;
+
+    for (u32 t = first; t < last; t++) {
+        for (int k = 0; k < 3; k++)
+            work->valence[indices[t*3+k]]++;
+    }
+
+    for (u32 t = first; t < last; t++) {
+        for (int k = 0; k < 3; k++) {
+            u32 v = indices[t*3+k];
+            work->position[v] = -1;
+            work->score[v] = vertex_score(-1, work->valence[v]);
+        }
+    }
+
+    for (u32 t = first; t < last; t++)
+        work->emitted[t] = false;
+
+    u32 cache[CACHE_SIZE + 3];
+    u32 cache_amount = 0;
+
+    u32 next = first; // where to go looking when the cache has nothing
+    i64 best = -1;
+
+    for (u32 i = 0; i < range.length; i++) {
+        if (best < 0) {
+            while (work->emitted[next])
+                next++;
+
+            best = next;
+        }
+
+        const u32 *triangle = &indices[best*3];
+
+        memcpy(&work->order[i*3], triangle, sizeof(u32)*3);
+        work->emitted[best] = true;
+
+        // the new one goes in front, everything else moves back
+        u32 updated[CACHE_SIZE + 3];
+        u32 updated_amount = 0;
+
+        for (int k = 0; k < 3; k++) {
+            work->valence[triangle[k]]--;
+            updated[updated_amount++] = triangle[k];
+        }
+
+        for (u32 c = 0; c < cache_amount; c++) {
+            u32 v = cache[c];
+
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                updated[updated_amount++] = v;
+        }
+
+        for (u32 c = 0; c < updated_amount; c++) {
+            u32 v = updated[c];
+
+            work->position[v] = c < CACHE_SIZE ? (i32)c : -1;
+            work->score[v] = vertex_score(work->position[v], work->valence[v]);
+        }
+
+        // only triangles around the touched vertices changed score, and
+        // the next one is picked from those
+        f32 best_score = -1.0f;
+        best = -1;
+
+        for (u32 c = 0; c < updated_amount; c++) {
+            u32 v = updated[c];
+
+            for (u32 a = work->offsets[v]; a < work->offsets[v+1]; a++) {
+                u32 t = work->adjacent[a];
+
+                if (t < first || t >= last || work->emitted[t])
+                    continue;
+
+                const u32 *other = &indices[t*3];
+                f32 score = work->score[other[0]] + work->score[other[1]] + work->score[other[2]];
+
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+
+        cache_amount = min(updated_amount, CACHE_SIZE);
+        memcpy(cache, updated, sizeof(u32) * cache_amount);
+    }
+
+    for (u32 i = 0; i < range.length*3; i++) {
+        work->valence[work->order[i]] = 0;
+        work->position[work->order[i]] = -1;
+    }
+}
+
+typedef struct {
+    u32 first, length;
+    f32 sort;
+} Cluster;
+
+static int compare_clusters(const void *a, const void *b) {
+    const Cluster *x = a, *y = b;
+
+    if (x->sort != y->sort)
+        return x->sort < y->sort ? 1 : -1;
+
+    return x->first < y->first ? -1 : 1;
+}
+
+// the orders' misses in a small fifo, like the hardware has
+static u32 fifo_misses(u32 *fifo, u32 *head, const u32 *triangle) {
+    u32 misses = 0;
+
+    for (int k = 0; k < 3; k++) {
+        bool found = false;
+
+        for (u32 f = 0; f < FIFO_SIZE; f++)
+            found |= fifo[f] == triangle[k];
+
+        if (!found) {
+            fifo[*head] = triangle[k];
+            *head = (*head + 1) % FIFO_SIZE;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+// sander, nehab and barczak's fast triangle reordering: cut the cache
+// order into clusters where that doesn't cost much, then draw the ones
+// facing away from the middle first, they're usually the ones in front
+static bool cluster_range(Work *work, const Vertex *vertices, Range range, u32 *out) {
+    const u32 *order = work->order;
+    u32 fifo[FIFO_SIZE], head = 0;
+
+    memset(fifo, 0xFF, sizeof(fifo));
+
+    u32 total = 0;
+    for (u32 t = 0; t < range.length; t++)
+        total += fifo_misses(fifo, &head, &order[t*3]);
+
+    f32 limit = (f32)total / range.length * OVERDRAW_THRESHOLD;
+
+    Cluster *clusters = malloc(sizeof(Cluster) * range.length);
+    if (!clusters)
+        return false;
+
+    u32 cluster_amount = 0;
+    u32 start = 0, misses = 0;
+
+    memset(fifo, 0xFF, sizeof(fifo));
+    head = 0;
+
+    for (u32 t = 0; t < range.length; t++) {
+        u32 m = fifo_misses(fifo, &head, &order[t*3]);
+
+        // starting over from nothing is a free place to cut
+        if (m == 3 && t > start) {
+            clusters[cluster_amount++] = (Cluster) { start, t - start, 0.0f };
+            start = t;
+            misses = 0;
+        }
+
+        misses += m;
+
+        if ((f32)misses / (t + 1 - start) <= limit) {
+            clusters[cluster_amount++] = (Cluster) { start, t + 1 - start, 0.0f };
+            start = t + 1;
+            misses = 0;
+
+            // the next cluster doesn't get to use this one's vertices
+            memset(fifo, 0xFF, sizeof(fifo));
+        }
+    }
+
+    if (start < range.length)
+        clusters[cluster_amount++] = (Cluster) { start, range.length - start, 0.0f };
+
+    // area weighted middle of the whole range
+    f32 middle[3] = { 0 }, area = 0.0f;
+    f32 (*normals)[3] = malloc(sizeof(f32) * 3 * range.length);
+
+    if (!normals) {
+        free(clusters);
+        return false;
+    }
+
+    for (u32 t = 0; t < range.length; t++) {
+        const f32 *a = vertices[order[t*3+0]].position;
+        const f32 *b = vertices[order[t*3+1]].position;
+        const f32 *c = vertices[order[t*3+2]].position;
+
+        f32 e1[3], e2[3];
+        vec_sub(e1, (f32 *)b, (f32 *)a, 3);
+        vec_sub(e2, (f32 *)c, (f32 *)a, 3);
+        vec3_cross(normals[t], e1, e2);
+
+        f32 weight = sqrtf(vec_dot(normals[t], normals[t], 3));
+        area += weight;
+
+        for (int i = 0; i < 3; i++)
+            middle[i] += (a[i] + b[i] + c[i]) / 3.0f * weight;
+    }
+
+    for (int i = 0; i < 3; i++)
+        middle[i] = area > 0.0f ? middle[i] / area : 0.0f;
+
+    for (u32 i = 0; i < cluster_amount; i++) {
+        Cluster *cluster = &clusters[i];
+        f32 center[3] = { 0 }, normal[3] = { 0 }, weight = 0.0f;
+
+        for (u32 t = cluster->first; t < cluster->first + cluster->length; t++) {
+            f32 w = sqrtf(vec_dot(normals[t], normals[t], 3));
+            weight += w;
+
+            for (int k = 0; k < 3; k++) {
+                normal[k] += normals[t][k];
+
+                for (int c = 0; c < 3; c++)
+                    center[k] += vertices[order[t*3+c]].position[k] / 3.0f * w;
+            }
+        }
+
+        f32 length = sqrtf(vec_dot(normal, normal, 3));
+
+        if (weight <= 0.0f || length <= 0.0f) {
+            cluster->sort = 0.0f;
+            continue;
+        }
+
+        for (int k = 0; k < 3; k++)
+            center[k] = center[k] / weight - middle[k];
+
+        cluster->sort = vec_dot(center, normal, 3) / length;
+    }
+
+    qsort(clusters, cluster_amount, sizeof(Cluster), compare_clusters);
+
+    for (u32 i = 0; i < cluster_amount; i++) {
+        memcpy(out, &order[clusters[i].first*3], sizeof(u32) * 3 * clusters[i].length);
+        out += clusters[i].length * 3;
+    }
+
+    free(normals);
+    free(clusters);
+
+    return true;
+}
+
+// vertices in the order the triangles first use them, so fetching them
+// walks through memory instead of jumping around
+static bool order_vertices(MeshSlice *mesh, u32 corners) {
+    u32 *remap = malloc(sizeof(u32) * mesh->length);
+    Vertex *data = malloc(sizeof(Vertex) * mesh->length);
+    VertexAnim *animation = mesh->animation ? malloc(sizeof(VertexAnim) * mesh->length) : NULL;
+
+    if (!remap || !data || (mesh->animation && !animation)) {
+        free(remap);
+        free(data);
+        free(animation);
+        return false;
+    }
+
+    memset(remap, 0xFF, sizeof(u32) * mesh->length);
+
+    u32 length = 0;
+
+    for (u32 i = 0; i < corners; i++) {
+        if (remap[mesh->indices[i]] == ~0u)
+            remap[mesh->indices[i]] = length++;
+    }
+
+    // ones nothing uses go at the end
+    for (u32 v = 0; v < mesh->length; v++) {
+        if (remap[v] == ~0u)
+            remap[v] = length++;
+
+        data[remap[v]] = mesh->data[v];
+
+        if (animation)
+            animation[remap[v]] = mesh->animation[v];
+    }
+
+    for (u32 i = 0; i < corners; i++)
+        mesh->indices[i] = remap[mesh->indices[i]];
+
+    memcpy(mesh->data, data, sizeof(Vertex) * mesh->length);
+
+    if (animation)
+        memcpy(mesh->animation, animation, sizeof(VertexAnim) * mesh->length);
+
+    free(remap);
+    free(data);
+    free(animation);
+
+    return true;
+}
+
+int msh_optimize(MeshSlice *mesh, const Range *ranges, u32 range_amount) {
+    if (!mesh->indices || !mesh->data)
+        return 1;
+
+    // the lods' triangles count too, they use the same vertices
+    u32 triangles = (mesh->index_amount + mesh->lod_index_amount) / 3;
+    Range whole = { 0, msh_triangles(*mesh) };
+
+    if (!ranges) {
+        ranges = &whole;
+        range_amount = 1;
+    }
+
+    for (u32 r = 0; r < range_amount; r++) {
+        if ((u64)ranges[r].offset + ranges[r].length > triangles)
+            return 1;
+    }
+
+    for (u32 i = 0; i < triangles*3; i++) {
+        if (mesh->indices[i] >= mesh->length)
+            return 1;
+    }
+
+    Work work = {
+        .indices = mesh->indices,
+        .vertex_amount = mesh->length,
+        .offsets = malloc(sizeof(u32) * (mesh->length + 1)),
+        .adjacent = malloc(sizeof(u32) * (triangles*3 + 1)),
+        .valence = calloc(mesh->length, sizeof(u32)),
+        .position = malloc(sizeof(i32) * mesh->length),
+        .score = malloc(sizeof(f32) * mesh->length),
+        .emitted = malloc(sizeof(bool) * (triangles + 1)),
+        .order = malloc(sizeof(u32) * (triangles*3 + 1)),
+        .result = malloc(sizeof(u32) * (triangles*3 + 1)),
+    };
+
+    bool ok = work.offsets && work.adjacent && work.valence && work.position
+        && work.score && work.emitted && work.order && work.result;
+
+    if (ok) {
+        build_adjacency(mesh->indices, triangles, mesh->length, work.offsets, work.adjacent);
+        memcpy(work.result, mesh->indices, sizeof(u32) * triangles*3);
+    }
+
+    for (u32 r = 0; ok && r < range_amount; r++) {
+        if (!ranges[r].length)
+            continue;
+
+        order_range(&work, ranges[r]);
+
+        // the submesh keeps its triangles, just in another order
+        ok = cluster_range(&work, mesh->data, ranges[r], &work.result[ranges[r].offset*3]);
+    }
+
+    if (ok)
+        memcpy(mesh->indices, work.result, sizeof(u32) * triangles*3);
+
+    ok = ok && order_vertices(mesh, triangles*3);
+
+    free(work.offsets);
+    free(work.adjacent);
+    free(work.valence);
+    free(work.position);
+    free(work.score);
+    free(work.emitted);
+    free(work.order);
+    free(work.result);
+
+    return !ok;
+}
+
+// SIMPLIFYING
+
+#define SIMPLIFY_PASSES 64
+
+// garland and heckbert's quadric error metric, the planes of the triangles
+// around a vertex, weighted by area, so how far a point is from them is
+// quadric_error / weight
+typedef struct {
+    f64 a2, b2, c2, d2, ab, ac, ad, bc, bd, cd;
+    f64 weight;
+} Quadric;
+
+static Quadric plane_quadric(const f32 *a, const f32 *b, const f32 *c) {
+    f32 e1[3], e2[3], normal[3];
+
+    vec_sub(e1, (f32 *)b, (f32 *)a, 3);
+    vec_sub(e2, (f32 *)c, (f32 *)a, 3);
+    vec3_cross(normal, e1, e2);
+
+    f64 length = sqrt(vec_dot(normal, normal, 3));
+
+    if (length <= 0.0)
+        return (Quadric) { 0 };
+
+    f64 x = normal[0] / length, y = normal[1] / length, z = normal[2] / length;
+    f64 d = -(x*a[0] + y*a[1] + z*a[2]);
+    f64 w = length * 0.5;
+
+    return (Quadric) {
+        x*x*w, y*y*w, z*z*w, d*d*w,
+        x*y*w, x*z*w, x*d*w, y*z*w, y*d*w, z*d*w,
+        w
+    };
+}
+
+static void quadric_add(Quadric *q, const Quadric *other) {
+    f64 *to = (f64 *)q;
+    const f64 *from = (const f64 *)other;
+
+    for (size_t i = 0; i < sizeof(Quadric) / sizeof(f64); i++)
+        to[i] += from[i];
+}
+
+// squared distance of the point from the planes
+static f64 quadric_error(const Quadric *q, const f32 *p) {
+    f64 x = p[0], y = p[1], z = p[2];
+
+    f64 error = q->a2*x*x + q->b2*y*y + q->c2*z*z + q->d2
+        + 2.0 * (q->ab*x*y + q->ac*x*z + q->ad*x + q->bc*y*z + q->bd*y + q->cd*z);
+
+    return q->weight > 0.0 ? fabs(error) / q->weight : 0.0;
+}
+
+typedef struct {
+    u32 from, to;
+    f32 error;
+} Collapse;
+
+static int compare_collapses(const void *a, const void *b) {
+    const Collapse *x = a, *y = b;
+
+    if (x->error != y->error)
+        return x->error < y->error ? -1 : 1;
+
+    return x->from < y->from ? -1 : x->from > y->from;
+}
+
+typedef struct {
+    const Vertex *vertices;
+    u32 vertex_amount;
+
+    u32 *indices; // what's left, gets smaller
+    u32 triangles;
+
+    Quadric *quadrics;
+    bool *locked;  // on an open edge or a uv seam, those stay
+    bool *touched; // already part of a collapse this pass
+    u32 *remap;
+
+    u32 *offsets, *adjacent;
+    Collapse *collapses;
+
+    f64 error; // the biggest one so far, squared
+} Simplifier;
+
+static bool has_edge(const Simplifier *s, u32 a, u32 b) {
+    for (u32 i = s->offsets[a]; i < s->offsets[a+1]; i++) {
+        const u32 *t = &s->indices[s->adjacent[i]*3];
+
+        for (int k = 0; k < 3; k++) {
+            if (t[k] == a && t[(k+1)%3] == b)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+// seams are open edges too, the other side uses different vertices
+static void lock_borders(Simplifier *s) {
+    for (u32 t = 0; t < s->triangles; t++) {
+        for (int k = 0; k < 3; k++) {
+            u32 a = s->indices[t*3+k], b = s->indices[t*3+(k+1)%3];
+
+            if (!has_edge(s, b, a))
+                s->locked[a] = s->locked[b] = true;
+        }
+    }
+}
+
+// moving from onto to can't turn a triangle around
+static bool flips(const Simplifier *s, u32 from, u32 to) {
+    const f32 *target = s->vertices[to].position;
+
+    for (u32 i = s->offsets[from]; i < s->offsets[from+1]; i++) {
+        const u32 *t = &s->indices[s->adjacent[i]*3];
+
+        if (t[0] == to || t[1] == to || t[2] == to)
+            continue; // this one goes away
+
+        const f32 *p[3], *q[3];
+
+        for (int k = 0; k < 3; k++) {
+            p[k] = s->vertices[t[k]].position;
+            q[k] = t[k] == from ? target : p[k];
+        }
+
+        f32 e1[3], e2[3], before[3], after[3];
+
+        vec_sub(e1, (f32 *)p[1], (f32 *)p[0], 3);
+        vec_sub(e2, (f32 *)p[2], (f32 *)p[0], 3);
+        vec3_cross(before, e1, e2);
+
+        vec_sub(e1, (f32 *)q[1], (f32 *)q[0], 3);
+        vec_sub(e2, (f32 *)q[2], (f32 *)q[0], 3);
+        vec3_cross(after, e1, e2);
+
+        if (vec_dot(before, after, 3) <= 0.0f)
+            return true;
+    }
+
+    return false;
+}
+
+// one round of collapses, every vertex moves at most once. false if
+// nothing could go.
+static bool simplify_pass(Simplifier *s, u32 target) {
+    build_adjacency(s->indices, s->triangles, s->vertex_amount, s->offsets, s->adjacent);
+
+    u32 amount = 0;
+
+    for (u32 t = 0; t < s->triangles; t++) {
+        for (int k = 0; k < 3; k++) {
+            u32 from = s->indices[t*3+k], to = s->indices[t*3+(k+1)%3];
+
+            if (s->locked[from])
+                continue;
+
+            Quadric q = s->quadrics[from];
+            quadric_add(&q, &s->quadrics[to]);
+
+            s->collapses[amount++] = (Collapse) {
+                from, to, (f32)quadric_error(&q, s->vertices[to].position)
+            };
+        }
+    }
+
+    qsort(s->collapses, amount, sizeof(Collapse), compare_collapses);
+
+    // the cheap ones first, the rest waits for the next pass
+    f32 limit = amount ? s->collapses[amount/4].error : 0.0f;
+    u32 removed = 0, applied = 0;
+
+    for (u32 i = 0; i < amount && s->triangles - removed > target; i++) {
+        Collapse c = s->collapses[i];
+
+        if (c.error > limit && applied)
+            break;
+
+        if (s->touched[c.from] || s->touched[c.to] || flips(s, c.from, c.to))
+            continue;
+
+        for (u32 a = s->offsets[c.from]; a < s->offsets[c.from+1]; a++) {
+            const u32 *t = &s->indices[s->adjacent[a]*3];
+
+            if (t[0] == c.to || t[1] == c.to || t[2] == c.to)
+                removed++;
+
+            for (int k = 0; k < 3; k++)
+                s->touched[t[k]] = true;
+        }
+
+        s->remap[c.from] = c.to;
+        quadric_add(&s->quadrics[c.to], &s->quadrics[c.from]);
+        s->error = max(s->error, (f64)c.error);
+
+        s->collapses[applied++] = c;
+    }
+
+    u32 kept = 0;
+
+    for (u32 t = 0; t < s->triangles; t++) {
+        u32 a = s->remap[s->indices[t*3+0]];
+        u32 b = s->remap[s->indices[t*3+1]];
+        u32 c = s->remap[s->indices[t*3+2]];
+
+        if (a == b || b == c || c == a)
+            continue;
+
+        s->indices[kept*3+0] = a;
+        s->indices[kept*3+1] = b;
+        s->indices[kept*3+2] = c;
+        kept++;
+    }
+
+    s->triangles = kept;
+
+    for (u32 i = 0; i < applied; i++)
+        s->remap[s->collapses[i].from] = s->collapses[i].from;
+
+    memset(s->touched, 0, sizeof(bool) * s->vertex_amount);
+
+    return applied > 0;
+}
+
+static void simplify(Simplifier *s, u32 target) {
+    for (int pass = 0; pass < SIMPLIFY_PASSES && s->triangles > target; pass++) {
+        if (!simplify_pass(s, target))
+            break;
+    }
+}
+
+int msh_lods(MeshSlice *mesh, Range range, Lods *lods) {
+    *lods = (Lods) { .ranges = { range }, .amount = 1 };
+
+    if (!mesh->indices || !mesh->data || mesh->index_amount % 3)
+        return 1;
+
+    u32 corners = mesh->index_amount + mesh->lod_index_amount;
+
+    if (((u64)range.offset + range.length) * 3 > corners)
+        return 1;
+
+    const u32 *first = &mesh->indices[range.offset*3];
+
+    for (u32 i = 0; i < range.length*3; i++) {
+        if (first[i] >= mesh->length)
+            return 1;
+    }
+
+    u32 vertex_amount = mesh->length;
+
+    Simplifier s = {
+        .vertices = mesh->data,
+        .vertex_amount = vertex_amount,
+        .indices = malloc(sizeof(u32) * (range.length*3 + 1)),
+        .triangles = range.length,
+        .quadrics = calloc(vertex_amount, sizeof(Quadric)),
+        .locked = calloc(vertex_amount, sizeof(bool)),
+        .touched = calloc(vertex_amount, sizeof(bool)),
+        .remap = malloc(sizeof(u32) * vertex_amount),
+        .offsets = malloc(sizeof(u32) * (vertex_amount + 1)),
+        .adjacent = malloc(sizeof(u32) * (range.length*3 + 1)),
+        .collapses = malloc(sizeof(Collapse) * (range.length*3 + 1)),
+    };
+
+    bool ok = s.indices && s.quadrics && s.locked && s.touched && s.remap
+        && s.offsets && s.adjacent && s.collapses;
+
+    if (ok) {
+        memcpy(s.indices, first, sizeof(u32) * range.length*3);
+
+        for (u32 v = 0; v < vertex_amount; v++)
+            s.remap[v] = v;
+
+        for (u32 t = 0; t < s.triangles; t++) {
+            const u32 *i = &s.indices[t*3];
+            Quadric q = plane_quadric(
+                mesh->data[i[0]].position, mesh->data[i[1]].position, mesh->data[i[2]].position
+            );
+
+            for (int k = 0; k < 3; k++)
+                quadric_add(&s.quadrics[i[k]], &q);
+        }
+
+        build_adjacency(s.indices, s.triangles, vertex_amount, s.offsets, s.adjacent);
+        lock_borders(&s);
+    }
+
+    // every level goes on from the last one, about half of it each time
+    for (u32 level = 1; ok && level < LOD_AMOUNT; level++) {
+        u32 before = s.triangles;
+        simplify(&s, before / 2);
+
+        // not worth another draw range
+        if (!s.triangles || s.triangles > before - before / 4)
+            break;
+
+        u32 *indices = realloc(mesh->indices, sizeof(u32) * (corners + s.triangles*3));
+
+        if (!indices) {
+            ok = false;
+            break;
+        }
+
+        memcpy(&indices[corners], s.indices, sizeof(u32) * s.triangles*3);
+
+        lods->ranges[level] = (Range) { corners / 3, s.triangles };
+        lods->errors[level] = sqrtf((f32)s.error);
+        lods->amount++;
+
+        mesh->indices = indices;
+        mesh->lod_index_amount += s.triangles*3;
+        corners += s.triangles*3;
+    }
+
+    free(s.indices);
+    free(s.quadrics);
+    free(s.locked);
+    free(s.touched);
+    free(s.remap);
+    free(s.offsets);
+    free(s.adjacent);
+    free(s.collapses);
+
+    return !ok;
+}
+
+void msh_free(MeshSlice *mesh) {
+    free(mesh->data);
+    free(mesh->animation);
+    free(mesh->indices);
+
+    *mesh = (MeshSlice) { 0 };
+}
@@ -93,49 +93,221 @@ typedef struct {
     unsigned int flags;
 } IQMAnim;
 
-bool iqm_init(Model *map, const char *data) {
+// an empty box means "no idea", the renderer won't cull with it.
+// indices can be NULL, amount is how many of them (or vertices) to look at.
+static Box box_of(const Vertex *vertices, const u32 *indices, u32 amount) {
+    Box box = {
+        {0.0, 0.0, 0.0},
+        {0.0, 0.0, 0.0}
+    };
+
+    if (!amount)
+        return box;
+
+    const Vertex *first = &vertices[indices ? indices[0] : 0];
+
+    memcpy(box.min, first->position, sizeof(f32)*3);
+    memcpy(box.max, first->position, sizeof(f32)*3);
+
+    for (u32 v=1; v < amount; v++) {
+        const Vertex *vertex = &vertices[indices ? indices[v] : v];
+
+        for (int i=0; i < 3; i++)
+            box.min[i] = min(box.min[i], vertex->position[i]);
+
+        for (int i=0; i < 3; i++)
+            box.max[i] = max(box.max[i], vertex->position[i]);
+    }
+
+    return box;
+}
+
+// parents before children, whatever order the bones come in. a broken
+// parent chain (out of range or a loop) just makes a root.
+static u32 *bone_order(const Bone *bones, u32 amount) {
+    u32 *order = malloc(sizeof(u32) * amount);
+    u32 *chain = malloc(sizeof(u32) * amount);
+    bool *placed = calloc(amount, sizeof(bool));
+
+    u32 length = 0;
+
+    for (u32 i = 0; i < amount; i++) {
+        u32 links = 0;
+
+        for (u32 b = i; b < amount && !placed[b] && links < amount; b = bones[b].parent)
+            chain[links++] = b;
+
+        while (links--) {
+            if (placed[chain[links]])
+                continue;
+
+            placed[chain[links]] = true;
+            order[length++] = chain[links];
+        }
+    }
+
+    free(placed);
+    free(chain);
+
+    return order;
+}
+
+// model space matrices for every bone out of the local pose
+static void pose_bones(AnimationState *state) {
+    for (u32 o = 0; o < state->bone_amount; o++) {
+        u32 i = state->order[o];
+        u32 parent = state->bones[i].parent;
+
+        f32 local[16], world[16], above[16], skin[16];
+
+        mat4_from_transform(local, state->pose[i]);
+
+        if (parent < state->bone_amount && parent != i) {
+            memcpy(above, &state->transform_mat4[parent*16], sizeof(above));
+            mat4_mul(world, local, above);
+        } else {
+            memcpy(world, local, sizeof(world));
+        }
+
+        memcpy(&state->transform_mat4[i*16], world, sizeof(world));
+
+        mat4_mul(skin, &state->inverse_bind[i*16], world);
+        memcpy(&state->palette[i*16], skin, sizeof(skin));
+    }
+}
+
+static bool iqm_section(const IQMHeader *header, u32 offset, u64 amount, u64 size) {
+    return offset + amount * size <= header->filesize;
+}
+
+static bool iqm_name(const IQMHeader *header, u32 name) {
+    return name < header->num_text || (!header->num_text && !name);
+}
+
+// every offset, count and name has to stay inside the file, nothing gets
+// checked again while loading
+static bool iqm_valid(const IQMHeader *header, const char *data) {
+    const IQMHeader *h = header;
+
+    bool valid =
+        iqm_section(h, h->ofs_text, h->num_text, 1)
+        && iqm_section(h, h->ofs_meshes, h->num_meshes, sizeof(IQMMesh))
+        && iqm_section(h, h->ofs_vertexarrays, h->num_vertexarrays, sizeof(IQMVertexArray))
+        && iqm_section(h, h->ofs_triangles, h->num_triangles, sizeof(u32)*3)
+        && iqm_section(h, h->ofs_joints, h->num_joints, sizeof(IQMJoint))
+        && iqm_section(h, h->ofs_poses, h->num_poses, sizeof(IQMPose))
+        && iqm_section(h, h->ofs_anims, h->num_anims, sizeof(IQMAnim))
+        && iqm_section(h, h->ofs_frames, (u64)h->num_frames * h->num_framechannels, sizeof(u16))
+        && iqm_section(h, h->ofs_comment, h->num_comment, 1);
+
+    if (!valid)
+        return false;
+
+    if (h->num_text && data[h->ofs_text + h->num_text - 1])
+        return false;
+
+    const u32 *indices = (const u32 *)(data + h->ofs_triangles);
+    for (u64 i = 0; i < (u64)h->num_triangles * 3; i++) {
+        if (indices[i] >= h->num_vertexes)
+            return false;
+    }
+
+    const IQMMesh *meshes = (const IQMMesh *)(data + h->ofs_meshes);
+    for (u32 i = 0; i < h->num_meshes; i++) {
+        const IQMMesh *m = &meshes[i];
+
+        if (!iqm_name(h, m->name))
+            return false;
+
+        // the ranges get drawn as they are
+        if ((u64)m->first_triangle + m->num_triangles > h->num_triangles
+            || (u64)m->first_vertex + m->num_vertexes > h->num_vertexes)
+            return false;
+    }
+
+    const IQMJoint *joints = (const IQMJoint *)(data + h->ofs_joints);
+    for (u32 i = 0; i < h->num_joints; i++) {
+        if (!iqm_name(h, joints[i].name))
+            return false;
+    }
+
+    const IQMAnim *anims = (const IQMAnim *)(data + h->ofs_anims);
+    for (u32 i = 0; i < h->num_anims; i++) {
+        if (!iqm_name(h, anims[i].name))
+            return false;
+    }
+
+    // the frames have one u16 per channel the poses use
+    const IQMPose *poses = (const IQMPose *)(data + h->ofs_poses);
+    u64 channels = 0;
+
+    for (u32 i = 0; i < h->num_poses; i++) {
+        for (int c = 0; c < 10; c++)
+            channels += (poses[i].channelmask >> c) & 1;
+    }
+
+    return !h->num_frames || channels == h->num_framechannels;
+}
+
+// a vertex array, if it's in the one format we understand
+static const void *iqm_array(const IQMHeader *header, const char *data, IQMVertexArray va, u32 format, u32 size, u32 bytes) {
+    if (va.format != format || va.size != size)
+        return NULL;
+
+    if (!iqm_section(header, va.offset, (u64)header->num_vertexes * size, bytes))
+        return NULL;
+
+    return data + va.offset;
+}
+
+static bool iqm_init(Model *map, const char *data, size_t size) {
+    if (size < sizeof(IQMHeader))
+        return true;
+
     IQMHeader header = *(IQMHeader *)data;
 
     // Check data
-    if (strcmp(header.magic, IQM_MAGIC)) {
+    if (memcmp(header.magic, IQM_MAGIC, sizeof(IQM_MAGIC)) || header.version != IQM_VERSION)
         return true;
-    }
 
-    const char *text = header.ofs_text ? &data[header.ofs_text] : "";
+    if (header.filesize < sizeof(IQMHeader) || header.filesize > size || !iqm_valid(&header, data))
+        return true;
+
+    const char *text = header.num_text ? &data[header.ofs_text] : "";
 
     // Find our data (does a lot of assumptions but who the fuck cares.)
-    f32 *positions = NULL;
-    Color *colors = NULL;
-    f32 *uvs = NULL;
-    u8 *blend_indices = NULL;
-    u8 *blend_weight = NULL;
+    const f32 *positions = NULL;
+    const Color *colors = NULL;
+    const f32 *uvs = NULL;
+    const u8 *blend_indices = NULL;
+    const u8 *blend_weight = NULL;
 
     IQMVertexArray *vertex_arrays = (IQMVertexArray *)(data+header.ofs_vertexarrays);
     for (u32 i = 0; i < header.num_vertexarrays; i++) {
         IQMVertexArray va = vertex_arrays[i];
         switch (va.type) {
             case IQM_POSITION: {
-                positions = (f32 *)(data+va.offset);
+                positions = iqm_array(&header, data, va, IQM_FLOAT, 3, sizeof(f32));
                 break;
             }
 
             case IQM_TEXCOORD: {
-                uvs = (f32 *)(data+va.offset);
+                uvs = iqm_array(&header, data, va, IQM_FLOAT, 2, sizeof(f32));
                 break;
             }
 
             case IQM_COLOR: {
-                colors = (Color *)(data+va.offset);
+                colors = iqm_array(&header, data, va, IQM_UBYTE, 4, sizeof(u8));
                 break;
             }
 
             case IQM_BLENDINDEXES: {
-                blend_indices = (u8 *)(data+va.offset);
+                blend_indices = iqm_array(&header, data, va, IQM_UBYTE, 4, sizeof(u8));
                 break;
             }
 
             case IQM_BLENDWEIGHTS: {
-                blend_weight = (u8 *)(data+va.offset);
+                blend_weight = iqm_array(&header, data, va, IQM_UBYTE, 4, sizeof(u8));
                 break;
             }
 
@@ -143,36 +315,39 @@ bool iqm_init(Model *map, const char *data) {
         }
     }
 
-    Box box = {
-        {0.0, 0.0, 0.0},
-        {0.0, 0.0, 0.0}
-    };
+    // the palette only has num_joints bones, and so does the shader's
+    if (header.num_joints && blend_indices) {
+        for (u64 i = 0; i < (u64)header.num_vertexes * 4; i++) {
+            if (blend_indices[i] >= header.num_joints)
+                return true;
+        }
+    }
 
-    // Assemble data
-    u16 vertex_amount = header.num_triangles * 3;
+    // Assemble data, the vertices stay indexed like in the file
+    u32 vertex_amount = header.num_vertexes;
+    u32 index_amount = header.num_triangles * 3;
     Vertex *vertices = falloc(Vertex, vertex_amount);
     VertexAnim *animdata = NULL;
 
-    u32 *indices = (u32 *)(data+header.ofs_triangles);
-    for (u32 i=0; i < vertex_amount; i++) {
-        u32 k = indices[i];
+    u32 *indices = falloc(u32, index_amount);
+    memcpy(indices, data+header.ofs_triangles, sizeof(u32) * index_amount);
+
+    bool skinned = header.num_joints && blend_indices && blend_weight;
 
+    if (skinned)
+        animdata = falloc(VertexAnim, vertex_amount);
+
+    // every array in one go
+    for (u32 k=0; k < vertex_amount; k++) {
         Vertex o = {
             { 0.f, 0.f, 0.f },
             { 0.f, 0.f },
             { .full = 0xFFFFFFFF }
         };
 
-        if (positions != NULL) {
+        if (positions != NULL)
             memcpy(o.position, &positions[k*3], sizeof(f32)*3);
 
-            for (int i=0; i < 3; i++)
-                box.min[i] = min(box.min[i], o.position[i]);
-
-            for (int i=0; i < 3; i++)
-                box.max[i] = max(box.max[i], o.position[i]);
-        }
-
         if (uvs != NULL)
             memcpy(o.uv, &uvs[k*2], sizeof(f32)*2);
 
@@ -189,38 +364,56 @@ bool iqm_init(Model *map, const char *data) {
             //o.color.b = min(255, max(0, (int)o.color.b - (rand() % 8)));
         }
 
-        vertices[i] = o;
+        vertices[k] = o;
+
+        if (skinned) {
+            memcpy(animdata[k].bone,   &blend_indices[k*4],4);
+            memcpy(animdata[k].weight, &blend_weight[k*4], 4);
+        }
     }
 
     //qsort(vertices, header.num_triangles/3, sizeof(Triangle), compare_triangles_2D);
 
-    if (header.num_joints && blend_indices) {
-        animdata = falloc(VertexAnim, vertex_amount);
-
-        for (u32 i=0; i < vertex_amount; i++) {
-            u32 k = indices[i];
-
-            memcpy(animdata[i].bone,   &blend_indices[k*4],4);
-            memcpy(animdata[i].weight, &blend_weight[k*4], 4);
-        }
-
-        map->animation.bones     = malloc(sizeof(Bone)     *header.num_joints);
-        map->animation.bind_pose = malloc(sizeof(Transform)*header.num_joints);
-        map->animation.pose      = malloc(sizeof(Transform)*header.num_joints);
+    if (skinned) {
+        map->animation.bones          = malloc(sizeof(Bone)     *header.num_joints);
+        map->animation.bind_pose      = malloc(sizeof(Transform)*header.num_joints);
+        map->animation.pose           = malloc(sizeof(Transform)*header.num_joints);
+        map->animation.inverse_bind   = malloc(sizeof(f32)*16   *header.num_joints);
+        map->animation.transform_mat4 = malloc(sizeof(f32)*16   *header.num_joints);
+        map->animation.palette        = malloc(sizeof(f32)*16   *header.num_joints);
 
         IQMJoint *joints  = (IQMJoint *)(data+header.ofs_joints);
         map->animation.bone_amount = header.num_joints;
 
+        const f32 identity[16] = IDENTITY_MATRIX;
+
         for (unsigned int i = 0; i < header.num_joints; i++) {
             const IQMJoint j = joints[i];
 
-            strncpy(map->animation.bones[i].name, &text[j.name], 64);
+            strncpy(map->animation.bones[i].name, &text[j.name], 63);
+            map->animation.bones[i].name[63] = 0;
 
             map->animation.bones[i].transform = j.transform;
             map->animation.bones[i].parent = j.parent;
             map->animation.bind_pose[i] = j.transform;
+            map->animation.pose[i] = j.transform;
+
+            memcpy(&map->animation.inverse_bind[i*16], identity, sizeof(identity));
         }
 
+        map->animation.order = bone_order(map->animation.bones, header.num_joints);
+
+        // the bind pose in model space, which skinning undoes
+        pose_bones(&map->animation);
+
+        for (unsigned int i = 0; i < header.num_joints; i++) {
+            f32 world[16];
+            memcpy(world, &map->animation.transform_mat4[i*16], sizeof(world));
+            mat4_invert(&map->animation.inverse_bind[i*16], world);
+        }
+
+        pose_bones(&map->animation);
+
         if (header.num_anims) {
             IQMAnim *rawanim = (IQMAnim *)&data[header.ofs_anims];
 
@@ -242,10 +435,11 @@ bool iqm_init(Model *map, const char *data) {
             }
         }
 
-        if (header.num_frames) {
+        if (header.num_frames && header.num_poses == header.num_joints) {
             IQMPose *posedata = (IQMPose *)&data[header.ofs_poses];
 
             map->animation.frames = malloc(sizeof(AnimationFrame)*header.num_frames);
+            map->animation.frame_amount = header.num_frames;
             unsigned short *framedata = (unsigned short *)&data[header.ofs_frames];
 
             for (unsigned int i=0; i<header.num_frames; i++) {
@@ -275,11 +469,20 @@ bool iqm_init(Model *map, const char *data) {
         }
     }
 
-    if (header.num_comment)
-        map->extra = SDL_strdup(data+header.ofs_comment);
+    // it doesn't have to end in a zero
+    if (header.num_comment) {
+        map->extra = malloc(header.num_comment + 1);
+
+        if (map->extra) {
+            memcpy(map->extra, data+header.ofs_comment, header.num_comment);
+            map->extra[header.num_comment] = 0;
+        }
+    }
 
     map->mesh = (MeshSlice) {
-        vertices, animdata, vertex_amount, box
+        vertices, animdata, vertex_amount,
+        box_of(vertices, NULL, vertex_amount),
+        indices, index_amount, 0
     };
 
     map->submesh_amount = header.num_meshes;
@@ -291,8 +494,9 @@ bool iqm_init(Model *map, const char *data) {
         IQMMesh mesh = meshes[i];
 
         map->submeshes[i] = (SubMesh) {
-            .name = SDL_strdup(&data[header.ofs_text+mesh.name]),
-            .range = { mesh.first_triangle, mesh.num_triangles }
+            .name = SDL_strdup(&text[mesh.name]),
+            .range = { mesh.first_triangle, mesh.num_triangles },
+            .box = box_of(vertices, &indices[mesh.first_triangle*3], mesh.num_triangles*3),
         };
     }
 
@@ -300,64 +504,670 @@ bool iqm_init(Model *map, const char *data) {
 }
 
 
-#define BBM_MAGIC "BASKETMODELv0.1"
+// basket's own models, laid out just like the structures in basket.h so
+// a model can point straight into the file (a mapped package entry, even)
+// instead of being parsed. offsets are from the start of the file and every
+// section starts on 16 bytes. little endian, like everything we run on.
+// any change to the layout below bumps the magic: v1 files come in two
+// layouts (with and without the index fields) so neither is read anymore,
+// v2 is the first with indices and lods.
+#define BBM_MAGIC "BASKETMODELv2"
+#define BBM_ALIGN 16
 
 typedef struct {
-    char magic[16]; // BASKETMODELv0.1\0
+    char magic[16]; // BASKETMODELv2\0
+    u32 size;       // all of the file
+    Box box;
 
-    u32 vertex_amount;
-    u16 vertex_offset;
-    u32 extra_amount; // if 0, ignore
-    u32 extra_offset;
-} BasketModelHeader;
+    u32 vertex_amount, vertices, vertex_animation; // Vertex, VertexAnim or 0
+    u32 index_amount, lod_index_amount, indices;   // u32, 0 for a triangle soup
 
-bool bbm_init(Model *map, const char *data) {
-    BasketModelHeader header = *(BasketModelHeader*)(data);
+    u32 bone_amount, bones;             // Bone
+    u32 bind_pose, order, inverse_bind; // Transform, u32, f32[16]
 
-    if (strcmp(header.magic, BBM_MAGIC)) {
-        return true;
+    u32 animation_amount, animations;   // BBMAnimation
+    u32 frame_amount, frames;           // bone_amount Transforms each
+
+    u32 submesh_amount, submeshes;      // BBMSubMesh
+
+    u32 text, text_size; // every name, zero terminated
+    u32 extra;           // into text, ~0 if there's none
+} BBMHeader;
+
+typedef struct {
+    u32 name; // into text
+    u32 first, last;
+    f32 rate;
+    u32 loops;
+} BBMAnimation;
+
+typedef struct {
+    u32 name; // into text
+    Range range;
+    Box box;
+    Lods lods;
+} BBMSubMesh;
+
+static bool bbm_section(const BBMHeader *header, u32 offset, u64 amount, u64 size) {
+    return offset % 4 == 0 && offset + amount * size <= header->size;
+}
+
+static bool bbm_name(const BBMHeader *header, u32 name) {
+    return name < header->text_size;
+}
+
+// everything has to be inside the file, nothing gets checked again later
+static bool bbm_valid(const BBMHeader *header, size_t size) {
+    if (size < sizeof(BBMHeader) || memcmp(header->magic, BBM_MAGIC, sizeof(BBM_MAGIC)))
+        return false;
+
+    if (header->size < sizeof(BBMHeader) || header->size > size)
+        return false;
+
+    const char *data = (const char *)header;
+    const u64 corners = (u64)header->index_amount + header->lod_index_amount;
+
+    bool valid =
+        bbm_section(header, header->vertices, header->vertex_amount, sizeof(Vertex))
+        && (!header->vertex_animation || bbm_section(header, header->vertex_animation, header->vertex_amount, sizeof(VertexAnim)))
+        && (!header->index_amount || bbm_section(header, header->indices, corners, sizeof(u32)))
+        && bbm_section(header, header->bones, header->bone_amount, sizeof(Bone))
+        && bbm_section(header, header->bind_pose, header->bone_amount, sizeof(Transform))
+        && bbm_section(header, header->order, header->bone_amount, sizeof(u32))
+        && bbm_section(header, header->inverse_bind, header->bone_amount, sizeof(f32)*16)
+        && bbm_section(header, header->animations, header->animation_amount, sizeof(BBMAnimation))
+        && bbm_section(header, header->frames, (u64)header->frame_amount * header->bone_amount, sizeof(Transform))
+        && bbm_section(header, header->submeshes, header->submesh_amount, sizeof(BBMSubMesh))
+        && header->text + (u64)header->text_size <= header->size
+        && header->text_size && !data[header->text + header->text_size - 1];
+
+    if (!valid)
+        return false;
+
+    if (header->extra != ~0u && !bbm_name(header, header->extra))
+        return false;
+
+    // an index past the end would have the gpu read past the buffer
+    const u32 *indices = (const u32 *)(data + header->indices);
+    for (u64 i = 0; header->index_amount && i < corners; i++) {
+        if (indices[i] >= header->vertex_amount)
+            return false;
+    }
+
+    // same for the bones, skinning indexes the palette with them
+    const VertexAnim *animation = (const VertexAnim *)(data + header->vertex_animation);
+    for (u32 i = 0; header->vertex_animation && i < header->vertex_amount; i++) {
+        for (int k = 0; k < 4; k++) {
+            if (animation[i].bone[k] >= header->bone_amount)
+                return false;
+        }
+    }
+
+    const u32 *order = (const u32 *)(data + header->order);
+    for (u32 i = 0; i < header->bone_amount; i++) {
+        if (order[i] >= header->bone_amount)
+            return false;
+    }
+
+    const BBMAnimation *animations = (const BBMAnimation *)(data + header->animations);
+    for (u32 i = 0; i < header->animation_amount; i++) {
+        if (!bbm_name(header, animations[i].name))
+            return false;
+    }
+
+    // submesh ranges count triangles, of the indices or of the soup
+    const u64 triangles = (header->index_amount ? header->index_amount : header->vertex_amount) / 3;
+
+    const BBMSubMesh *submeshes = (const BBMSubMesh *)(data + header->submeshes);
+    for (u32 i = 0; i < header->submesh_amount; i++) {
+        const Range range = submeshes[i].range;
+        const Lods *lods = &submeshes[i].lods;
+
+        if (!bbm_name(header, submeshes[i].name) || lods->amount > LOD_AMOUNT)
+            return false;
+
+        if ((u64)range.offset + range.length > triangles)
+            return false;
+
+        // the renderer draws these without asking
+        for (u32 l = 0; l < lods->amount; l++) {
+            if (((u64)lods->ranges[l].offset + lods->ranges[l].length) * 3 > corners)
+                return false;
+        }
     }
 
-    u64 size = sizeof(Vertex) * header.vertex_amount;
-    map->mesh.data = malloc(size);
-    memcpy(map->mesh.data, data + header.vertex_offset, size);
+    return true;
+}
+
+int mod_map(Model *map, const char *data, size_t size) {
+    *map = (Model) { 0 };
+
+    const BBMHeader *header = (const BBMHeader *)data;
+
+    if ((uintptr_t)data % 4 || !bbm_valid(header, size))
+        return 1;
+
+    // nothing here gets written to, the casts are just to fit the structs
+    char *file = (char *)data;
+    char *text = file + header->text;
+
+    map->mapped = true;
+
+    map->mesh = (MeshSlice) {
+        .data = (Vertex *)(file + header->vertices),
+        .animation = header->vertex_animation ? (VertexAnim *)(file + header->vertex_animation) : NULL,
+        .length = header->vertex_amount,
+        .box = header->box,
+        .indices = header->index_amount ? (u32 *)(file + header->indices) : NULL,
+        .index_amount = header->index_amount,
+        .lod_index_amount = header->index_amount ? header->lod_index_amount : 0,
+    };
+
+    if (header->extra != ~0u)
+        map->extra = text + header->extra;
+
+    // names are pointers at runtime, so these two tables are the only
+    // thing that gets made
+    map->submesh_amount = header->submesh_amount;
+    map->submeshes = malloc(sizeof(SubMesh) * max(header->submesh_amount, 1));
 
-    if (header.extra_amount) {
-        map->extra = malloc(header.extra_amount);
-        memcpy(map->extra, data + header.extra_offset, header.extra_amount);
+    if (!map->submeshes) {
+        mod_free(map);
+        return 1;
     }
 
+    const BBMSubMesh *submeshes = (const BBMSubMesh *)(file + header->submeshes);
+
+    for (u32 i = 0; i < header->submesh_amount; i++) {
+        map->submeshes[i] = (SubMesh) {
+            .name = text + submeshes[i].name,
+            .range = submeshes[i].range,
+            .box = submeshes[i].box,
+            .lods = submeshes[i].lods,
+        };
+    }
+
+    if (!header->bone_amount)
+        return 0;
+
+    AnimationState *state = &map->animation;
+
+    state->mapped = true;
+    state->bone_amount = header->bone_amount;
+    state->bones = (Bone *)(file + header->bones);
+    state->bind_pose = (Transform *)(file + header->bind_pose);
+    state->order = (u32 *)(file + header->order);
+    state->inverse_bind = (f32 *)(file + header->inverse_bind);
+
+    state->animation_amount = header->animation_amount;
+    state->animations = malloc(sizeof(Animation) * max(header->animation_amount, 1));
+
+    if (!state->animations) {
+        mod_free(map);
+        return 1;
+    }
+
+    const BBMAnimation *animations = (const BBMAnimation *)(file + header->animations);
+
+    for (u32 i = 0; i < header->animation_amount; i++) {
+        state->animations[i] = (Animation) {
+            .name = text + animations[i].name,
+            .first = animations[i].first,
+            .last = animations[i].last,
+            .rate = animations[i].rate,
+            .loops = animations[i].loops,
+        };
+    }
+
+    if (header->frame_amount) {
+        state->frame_amount = header->frame_amount;
+        state->frames = malloc(sizeof(AnimationFrame) * header->frame_amount);
+
+        if (!state->frames) {
+            mod_free(map);
+            return 1;
+        }
+
+        Transform *frames = (Transform *)(file + header->frames);
+
+        for (u32 i = 0; i < header->frame_amount; i++)
+            state->frames[i] = &frames[i * header->bone_amount];
+    }
+
+    state->pose           = malloc(sizeof(Transform)*header->bone_amount);
+    state->transform_mat4 = malloc(sizeof(f32)*16   *header->bone_amount);
+    state->palette        = malloc(sizeof(f32)*16   *header->bone_amount);
+
+    if (!state->pose || !state->transform_mat4 || !state->palette) {
+        mod_free(map);
+        return 1;
+    }
+
+    memcpy(state->pose, state->bind_pose, sizeof(Transform)*header->bone_amount);
+    pose_bones(state);
+
+    return 0;
+}
+
+// a copy of the file, so it doesn't have to stay around
+static bool bbm_init(Model *map, const char *data, size_t size) {
+    const BBMHeader *header = (const BBMHeader *)data;
+
+    if (size < sizeof(BBMHeader) || memcmp(header->magic, BBM_MAGIC, sizeof(BBM_MAGIC)))
+        return true;
+
+    if (header->size < sizeof(BBMHeader) || header->size > size)
+        return true;
+
+    char *copy = malloc(header->size);
+    if (!copy)
+        return true;
+
+    memcpy(copy, data, header->size);
+
+    if (mod_map(map, copy, header->size)) {
+        free(copy);
+        return true;
+    }
+
+    map->copy = copy;
+
     return false;
 }
 
+static u32 align_up(u32 offset) {
+    return (offset + BBM_ALIGN - 1) & ~(u32)(BBM_ALIGN - 1);
+}
+
+// a name into the text section, counting how much room they take first
+static u32 put_name(char *text, u32 *used, const char *name) {
+    u32 at = *used;
+    size_t length = strlen(name ? name : "") + 1;
+
+    if (text)
+        memcpy(text + at, name ? name : "", length);
+
+    *used += length;
+    return at;
+}
+
+int mod_store(const Model *model, const char *package, const char *name) {
+    const AnimationState *state = &model->animation;
+    const u32 bones = state->bone_amount;
+
+    BBMHeader header = {
+        .magic = BBM_MAGIC,
+        .box = model->mesh.box,
+        .vertex_amount = model->mesh.length,
+        .index_amount = model->mesh.indices ? model->mesh.index_amount : 0,
+        .lod_index_amount = model->mesh.indices ? model->mesh.lod_index_amount : 0,
+        .bone_amount = bones,
+        .animation_amount = bones ? state->animation_amount : 0,
+        .frame_amount = bones ? state->frame_amount : 0,
+        .submesh_amount = model->submesh_amount,
+        .extra = ~0u,
+    };
+
+    u32 text_size = 0;
+    for (u32 i = 0; i < header.animation_amount; i++)
+        put_name(NULL, &text_size, state->animations[i].name);
+
+    for (u32 i = 0; i < header.submesh_amount; i++)
+        put_name(NULL, &text_size, model->submeshes[i].name);
+
+    if (model->extra)
+        put_name(NULL, &text_size, model->extra);
+
+    // at least the one zero, so there always is some text
+    text_size = max(text_size, 1);
+
+    u32 size = align_up(sizeof(BBMHeader));
+
+    #define SECTION(field, bytes) do { header.field = size; size = align_up(size + (bytes)); } while (0)
+        SECTION(vertices, sizeof(Vertex) * header.vertex_amount);
+
+        if (model->mesh.animation)
+            SECTION(vertex_animation, sizeof(VertexAnim) * header.vertex_amount);
+
+        if (header.index_amount)
+            SECTION(indices, sizeof(u32) * (header.index_amount + header.lod_index_amount));
+
+        SECTION(bones, sizeof(Bone) * bones);
+        SECTION(bind_pose, sizeof(Transform) * bones);
+        SECTION(order, sizeof(u32) * bones);
+        SECTION(inverse_bind, sizeof(f32) * 16 * bones);
+        SECTION(animations, sizeof(BBMAnimation) * header.animation_amount);
+        SECTION(frames, sizeof(Transform) * bones * header.frame_amount);
+        SECTION(submeshes, sizeof(BBMSubMesh) * header.submesh_amount);
+        SECTION(text, text_size);
+    #undef SECTION
+
+    header.size = size;
+    header.text_size = text_size;
+
+    char *file = calloc(1, size);
+    if (!file)
+        return 1;
+
+    char *text = file + header.text;
+    u32 used = 0;
+
+    memcpy(file + header.vertices, model->mesh.data, sizeof(Vertex) * header.vertex_amount);
+
+    if (model->mesh.animation)
+        memcpy(file + header.vertex_animation, model->mesh.animation, sizeof(VertexAnim) * header.vertex_amount);
+
+    if (header.index_amount)
+        memcpy(file + header.indices, model->mesh.indices, sizeof(u32) * (header.index_amount + header.lod_index_amount));
+
+    if (bones) {
+        memcpy(file + header.bones, state->bones, sizeof(Bone) * bones);
+        memcpy(file + header.bind_pose, state->bind_pose, sizeof(Transform) * bones);
+        memcpy(file + header.order, state->order, sizeof(u32) * bones);
+        memcpy(file + header.inverse_bind, state->inverse_bind, sizeof(f32) * 16 * bones);
+    }
+
+    BBMAnimation *animations = (BBMAnimation *)(file + header.animations);
+
+    for (u32 i = 0; i < header.animation_amount; i++) {
+        Animation a = state->animations[i];
+
+        animations[i] = (BBMAnimation) {
+            put_name(text, &used, a.name), a.first, a.last, a.rate, a.loops
+        };
+    }
+
+    Transform *frames = (Transform *)(file + header.frames);
+
+    for (u32 i = 0; i < header.frame_amount; i++)
+        memcpy(&frames[i * bones], state->frames[i], sizeof(Transform) * bones);
+
+    BBMSubMesh *submeshes = (BBMSubMesh *)(file + header.submeshes);
+
+    for (u32 i = 0; i < header.submesh_amount; i++) {
+        SubMesh submesh = model->submeshes[i];
+
+        submeshes[i] = (BBMSubMesh) {
+            put_name(text, &used, submesh.name), submesh.range, submesh.box, submesh.lods
+        };
+    }
+
+    if (model->extra)
+        header.extra = put_name(text, &used, model->extra);
+
+    memcpy(file, &header, sizeof(header));
+
+    int result = pak_store(package, name, file, size);
+    free(file);
+
+    return result;
+}
+
+int mod_init(Model *map, const char *data, size_t size) {
+    *map = (Model) { 0 };
 
-int mod_init(Model *map, const char *data) {
-    if (!iqm_init(map, data)) {
+    if (!iqm_init(map, data, size)) {
         return 0;
     }
 
-    if (!bbm_init(map, data)) {
+    if (!bbm_init(map, data, size)) {
         return 0;
     }
 
     return 1;
 }
 
+typedef struct {
+    Transform *from, *to;
+    f32 t;
+} Sample;
+
+// the two frames around time, and how far between them it is. the bind
+// pose when there's no such animation.
+static Sample sample(const AnimationState *state, u32 animation, f32 time) {
+    Sample none = { state->bind_pose, state->bind_pose, 0.0f };
+
+    if (animation >= state->animation_amount || !state->frames)
+        return none;
+
+    Animation a = state->animations[animation];
+    u32 length = a.last; // it's the amount of frames
+
+    if (!length || a.first + length > state->frame_amount)
+        return none;
+
+    f32 frame = max(time, 0.0f) * a.rate;
+    f32 whole = SDL_floorf(frame);
+    f32 t = frame - whole;
+
+    u32 current, next;
+
+    if (a.loops) {
+        current = (u32)SDL_fmodf(whole, (f32)length);
+        next = (current + 1) % length;
+    } else {
+        current = (u32)min(whole, (f32)(length - 1));
+        next = min(current + 1, length - 1);
+
+        if (current == length - 1)
+            t = 0.0f;
+    }
+
+    return (Sample) {
+        state->frames[a.first + current],
+        state->frames[a.first + next],
+        t
+    };
+}
+
+void mod_pose_blend(Pose pose) {
+    AnimationState *state = pose.state;
+
+    if (!state || !state->bone_amount)
+        return;
+
+    Sample a = sample(state, pose.animation, pose.time);
+
+    if (pose.fade <= 0.0f) {
+        for (u32 i = 0; i < state->bone_amount; i++)
+            transform_lerp(&state->pose[i], &a.from[i], &a.to[i], a.t);
+    } else {
+        Sample b = sample(state, pose.into, pose.into_time);
+        f32 fade = min(pose.fade, 1.0f);
+
+        for (u32 i = 0; i < state->bone_amount; i++) {
+            Transform first, second;
+
+            transform_lerp(&first, &a.from[i], &a.to[i], a.t);
+            transform_lerp(&second, &b.from[i], &b.to[i], b.t);
+            transform_lerp(&state->pose[i], &first, &second, fade);
+        }
+    }
+
+    pose_bones(state);
+}
+
+void mod_pose(AnimationState *state, u32 animation, f32 time) {
+    mod_pose_blend((Pose) {
+        .state = state,
+        .animation = animation,
+        .time = time,
+    });
+}
+
+// a few per job, one skeleton alone is too little work to hand out
+#define POSES_PER_JOB 4
+
+typedef struct {
+    Pose *poses;
+    u32 amount;
+} PoseWork;
+
+static void pose_job(void *userdata, u32 index) {
+    PoseWork *work = userdata;
+
+    u32 first = index * POSES_PER_JOB;
+    u32 last = min(first + POSES_PER_JOB, work->amount);
+
+    for (u32 i = first; i < last; i++)
+        mod_pose_blend(work->poses[i]);
+}
+
+void mod_pose_many(Pose *poses, u32 amount) {
+    PoseWork work = { poses, amount };
+    job_parallel(pose_job, &work, (amount + POSES_PER_JOB - 1) / POSES_PER_JOB);
+}
+
+int mod_animation_new(AnimationState *out, const AnimationState *model) {
+    *out = *model;
+    out->borrowed = true;
+
+    if (!model->bone_amount)
+        return 0;
+
+    out->pose           = malloc(sizeof(Transform)*model->bone_amount);
+    out->transform_mat4 = malloc(sizeof(f32)*16   *model->bone_amount);
+    out->palette        = malloc(sizeof(f32)*16   *model->bone_amount);
+
+    if (!out->pose || !out->transform_mat4 || !out->palette) {
+        mod_animation_free(out);
+        return 1;
+    }
+
+    memcpy(out->pose, model->bind_pose, sizeof(Transform)*model->bone_amount);
+    pose_bones(out);
+
+    return 0;
+}
+
+void mod_animation_free(AnimationState *state) {
+    // only the tables with pointers in them were made, the rest is the file
+    if (state->mapped && !state->borrowed) {
+        free(state->animations);
+        free(state->frames);
+    } else if (!state->borrowed) {
+        for (u32 i = 0; i < state->animation_amount; i++)
+            free(state->animations[i].name);
+
+        for (u32 i = 0; i < state->frame_amount; i++)
+            free(state->frames[i]);
+
+        free(state->animations);
+        free(state->frames);
+        free(state->bones);
+        free(state->bind_pose);
+        free(state->order);
+        free(state->inverse_bind);
+    }
+
+    free(state->pose);
+    free(state->transform_mat4);
+    free(state->palette);
+
+    *state = (AnimationState) { 0 };
+}
+
+int mod_optimize(Model *model) {
+    // the file's arrays can't change
+    if (model->mapped || !model->mesh.indices)
+        return 1;
+
+    if (!model->submesh_amount)
+        return msh_optimize(&model->mesh, NULL, 0);
+
+    // the submeshes and every lod of them
+    Range *ranges = malloc(sizeof(Range) * model->submesh_amount * LOD_AMOUNT);
+    if (!ranges)
+        return 1;
+
+    u32 amount = 0;
+
+    for (u32 i = 0; i < model->submesh_amount; i++) {
+        const SubMesh *submesh = &model->submeshes[i];
+
+        ranges[amount++] = submesh->range;
+
+        for (u32 l = 1; l < submesh->lods.amount; l++)
+            ranges[amount++] = submesh->lods.ranges[l];
+    }
+
+    int result = msh_optimize(&model->mesh, ranges, amount);
+    free(ranges);
+
+    return result;
+}
+
+int mod_lods(Model *model) {
+    if (model->mapped || !model->mesh.indices)
+        return 1;
+
+    int result = 0;
+
+    for (u32 i = 0; i < model->submesh_amount; i++) {
+        SubMesh *submesh = &model->submeshes[i];
+        result |= msh_lods(&model->mesh, submesh->range, &submesh->lods);
+    }
+
+    return result;
+}
+
+MeshSlice mod_submesh(Model *model, u32 index) {
+    if (index >= model->submesh_amount)
+        return (MeshSlice) { 0 };
+
+    SubMesh submesh = model->submeshes[index];
+    u64 first = submesh.range.offset*3;
+
+    if (first + submesh.range.length*3 > msh_triangles(model->mesh)*3)
+        return (MeshSlice) { 0 };
+
+    // the vertices are shared, only the indices are its own
+    if (model->mesh.indices) {
+        MeshSlice slice = model->mesh;
+
+        slice.indices = &model->mesh.indices[first];
+        slice.index_amount = submesh.range.length*3;
+        slice.lod_index_amount = 0;
+        slice.box = submesh.box;
+
+        return slice;
+    }
+
+    return (MeshSlice) {
+        .data = &model->mesh.data[first],
+        .animation = model->mesh.animation ? &model->mesh.animation[first] : NULL,
+        .length = submesh.range.length*3,
+        .box = submesh.box,
+    };
+}
+
 void mod_free(Model *model) {
-    if (model->mesh.data)
-        free(model->mesh.data);
+    if (!model->mapped) {
+        if (model->mesh.data)
+            free(model->mesh.data);
 
-    if (model->mesh.animation)
-        free(model->mesh.animation);
+        if (model->mesh.animation)
+            free(model->mesh.animation);
 
-    model->mesh = (MeshSlice) { NULL, NULL, 0, { {0, 0, 0}, {0, 0, 0} } };
+        if (model->mesh.indices)
+            free(model->mesh.indices);
+
+        // a mapped one points into the file's text
+        free(model->extra);
+    }
+
+    model->mesh = (MeshSlice) { 0 };
 
     if (model->submeshes) {
-        for (unsigned int i=0; i < model->submesh_amount; i++)
+        for (unsigned int i=0; !model->mapped && i < model->submesh_amount; i++)
             free(model->submeshes[i].name);
 
         free(model->submeshes);
     }
 
-    // TODO: FREE ANIMATION
+    mod_animation_free(&model->animation);
+
+    free(model->copy);
+
+    *model = (Model) { 0 };
 }
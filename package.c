@@ -18,6 +18,7 @@
 #else
     #include <sys/mman.h>
     #include <sys/stat.h>
+    #include <dirent.h>
     #include <unistd.h>
     #include <limits.h>
     #define __USE_XOPEN_EXTENDED
@@ -28,8 +29,7 @@
 
 #endif
 
-#define MINIZ_NO_DEFLATE_APIS
-#define MINIZ_NO_ARCHIVE_WRITING_APIS
+// deflate is only here for pak_store
 #include "lib/miniz.h"
 
 typedef struct {
@@ -114,11 +114,93 @@ static void mmap_file_close(mmap_file* mf) {
     free(mf);
 }
 
+// zip numbers are little endian and not aligned to anything
+static u64 read_le(const u8 *data, int bytes) {
+    u64 value = 0;
+
+    for (int i = bytes - 1; i >= 0; i--)
+        value = value << 8 | data[i];
+
+    return value;
+}
+
+// the end of central directory record is at the very end of a zip, only
+// followed by its comment (up to 64K). it says how big the central
+// directory is and where it should be, relative to the start of the zip,
+// and since the directory sits right before the record, that tells us
+// where the zip starts. only a few pages at the end get touched.
+static long find_zip_end(mmap_file* mf) {
+    if (!mf || !mf->data || mf->size < 22) return -1;
+    const u8* data = (const u8*)mf->data;
+    size_t file_size = mf->size;
+
+    size_t lowest = file_size > 22 + 0xFFFF ? file_size - 22 - 0xFFFF : 0;
+
+    for (size_t end = file_size - 22 + 1; end-- > lowest;) {
+        if (memcmp(data + end, "\x50\x4b\x05\x06", 4) != 0)
+            continue;
+
+        // the comment has to reach the end exactly, or it's just some
+        // bytes that happen to look like a signature
+        if (end + 22 + read_le(data + end + 20, 2) != file_size)
+            continue;
+
+        u64 directory_size = read_le(data + end + 12, 4);
+        u64 directory_offset = read_le(data + end + 16, 4);
+        size_t directory_end = end;
+
+        // zip64 puts a locator right before, pointing at a bigger record
+        // that comes right before that (when there's no extensible data,
+        // which nobody writes)
+        if (end >= 20 + 56 && !memcmp(data + end - 20, "\x50\x4b\x06\x07", 4)) {
+            const u8* record = data + end - 20 - 56;
+
+            if (memcmp(record, "\x50\x4b\x06\x06", 4) != 0 || read_le(record + 4, 8) != 56 - 12)
+                continue;
+
+            directory_size = read_le(record + 40, 8);
+            directory_offset = read_le(record + 48, 8);
+            directory_end = end - 20 - 56;
+        }
+
+        if (directory_size > directory_end || directory_offset > directory_end - directory_size)
+            continue;
+
+        size_t start = directory_end - directory_size - directory_offset;
+
+        // an empty zip has nothing to check against
+        if (!directory_size)
+            return start;
+
+        // the first entry should point at a local header. zip -A style
+        // archives also land here, their offsets count from the file start
+        const u8* entry = data + start + directory_offset;
+
+        if (directory_size < 46 || memcmp(entry, "\x50\x4b\x01\x02", 4) != 0)
+            continue;
+
+        u64 local = read_le(entry + 42, 4);
+
+        if (local != 0xFFFFFFFF && (local > directory_offset || memcmp(data + start + local, "\x50\x4b\x03\x04", 4) != 0))
+            continue;
+
+        return start;
+    }
+
+    return -1;
+}
+
+// falls back to looking for local headers byte by byte, for zips with a
+// broken or missing end record
 static long find_zip_header(mmap_file* mf) {
     if (!mf || !mf->data || mf->size < 30) return -1;
     uint8_t* data = (uint8_t*)mf->data;
     long file_size = mf->size;
 
+    long start = find_zip_end(mf);
+    if (start != -1)
+        return start;
+
     if (memcmp(data, "\x50\x4b\x03\x04", 4) == 0)
         return 0;
 
@@ -158,69 +240,456 @@ static int is_directory(const char *path) {
     return S_ISDIR(path_stat.st_mode);
 }
 
-static char mounted_dir[PATH_MAX] = {0};
+#define MOUNT_AMOUNT 16
 
-static mmap_file *zip_file = NULL;
-static mz_zip_archive zip_archive;
+typedef struct {
+    char dir[PATH_MAX]; // folder mounts
 
-static void pak_unmount() {
-    mounted_dir[0] = 0;
+    mmap_file *file;    // zip mounts
+    mz_zip_archive zip;
+    const u8 *archive;  // where the zip starts inside file
+    size_t archive_size;
+} Mount;
+
+// every path in every mounted package, hashed when mounting so finding
+// one doesn't walk a zip's central directory (or the disk) every time.
+// the same path in a later mount replaces the earlier one.
+typedef struct {
+    u32 hash;
+    u32 name;  // into names, +1 so 0 is an empty spot
+    u32 mount;
+    i32 file;  // in the zip, -1 for folders
+    bool directory;
+} IndexEntry;
+
+static Mount mounts[MOUNT_AMOUNT]; // lowest priority first
+static u32 mount_amount;
+
+static IndexEntry *index_table; // open addressing, capacity is a power of two
+static u32 index_capacity, index_used;
+
+static char *names;
+static size_t names_size, names_capacity;
+
+// zip lookups never cared about case, so the index doesn't either. only
+// ascii gets folded, the names stay as they are for the folders on disk.
+static u8 fold(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : (u8)c;
+}
+
+static bool same_name(const char *a, const char *b) {
+    for (; *a && fold(*a) == fold(*b); a++, b++);
+
+    return fold(*a) == fold(*b);
+}
+
+// FNV-1a
+static u32 hash_name(const char *name) {
+    u32 hash = 2166136261u;
 
-    if (zip_archive.m_archive_size) {
-        mz_zip_reader_end(&zip_archive);
-        memset(&zip_archive, 0, sizeof(zip_archive));
+    for (; *name; name++) {
+        hash ^= fold(*name);
+        hash *= 16777619u;
     }
 
-    if (zip_file != NULL) {
-        mmap_file_close(zip_file);
-        zip_file = NULL;
+    return hash;
+}
+
+// the same file can be asked for as "a/b", "/a//b", "./a/b" or "a\b".
+// returns non-zero if it doesn't fit.
+static int normalize(char *out, const char *name, size_t capacity) {
+    size_t length = 0;
+
+    while (*name) {
+        char c = *name == '\\' ? '/' : *name;
+
+        // skip empty and "." parts
+        if (c == '/' || (c == '.' && (name[1] == '/' || name[1] == '\\' || !name[1])) ) {
+            if (c == '.')
+                name++;
+
+            while (*name == '/' || *name == '\\')
+                name++;
+
+            if (length && out[length-1] != '/' && *name) {
+                if (length + 1 >= capacity) return 1;
+                out[length++] = '/';
+            }
+
+            continue;
+        }
+
+        // the rest of the part, up to the next slash
+        while (*name && *name != '/' && *name != '\\') {
+            if (length + 1 >= capacity) return 1;
+            out[length++] = *name++;
+        }
     }
+
+    // "a/." leaves one behind
+    if (length && out[length-1] == '/')
+        length--;
+
+    out[length] = 0;
+
+    return 0;
 }
 
-int pak_mount(const char *name) {
+static void free_index() {
+    free(index_table);
+    free(names);
+
+    index_table = NULL;
+    index_capacity = index_used = 0;
+
+    names = NULL;
+    names_size = names_capacity = 0;
+}
+
+// where name sits in the table, or the empty spot it would go in
+static IndexEntry *probe(IndexEntry *table, u32 capacity, u32 hash, const char *name) {
+    u32 slot = hash & (capacity - 1);
+
+    while (table[slot].name) {
+        if (table[slot].hash == hash && same_name(&names[table[slot].name-1], name))
+            break;
+
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    return &table[slot];
+}
+
+static int grow_index() {
+    // at most half full, keeps the probes short
+    u32 capacity = index_capacity ? index_capacity * 2 : 256;
+    IndexEntry *table = calloc(capacity, sizeof(IndexEntry));
+
+    if (!table)
+        return 1;
+
+    for (u32 i = 0; i < index_capacity; i++) {
+        IndexEntry *entry = &index_table[i];
+
+        if (entry->name)
+            *probe(table, capacity, entry->hash, &names[entry->name-1]) = *entry;
+    }
+
+    free(index_table);
+    index_table = table;
+    index_capacity = capacity;
+
+    return 0;
+}
+
+// name has to be normalized already
+static int add_entry(const char *name, u32 mount, i32 file, bool directory) {
+    if (!*name)
+        return 0;
+
+    if ((index_used + 1) * 2 > index_capacity && grow_index())
+        return 1;
+
+    u32 hash = hash_name(name);
+    IndexEntry *entry = probe(index_table, index_capacity, hash, name);
+
+    // a folder's files get opened by the name, so it has to be their case
+    if (entry->name && !strcmp(&names[entry->name-1], name)) {
+        entry->mount = mount;
+        entry->file = file;
+        entry->directory = directory;
+        return 0;
+    }
+
+    size_t length = strlen(name) + 1;
+
+    if (names_size + length > names_capacity) {
+        size_t capacity = names_capacity ? names_capacity : 4096;
+        while (capacity < names_size + length)
+            capacity *= 2;
+
+        char *grown = realloc(names, capacity);
+        if (!grown)
+            return 1;
+
+        names = grown;
+        names_capacity = capacity;
+    }
+
+    memcpy(&names[names_size], name, length);
+
+    index_used += !entry->name;
+    *entry = (IndexEntry) { hash, names_size + 1, mount, file, directory };
+
+    names_size += length;
+
+    return 0;
+}
+
+static int index_zip(u32 mount) {
+    mz_zip_archive *zip = &mounts[mount].zip;
+    u32 amount = mz_zip_reader_get_num_files(zip);
+
+    char raw[PATH_MAX], name[PATH_MAX];
+
+    for (u32 i = 0; i < amount; i++) {
+        if (mz_zip_reader_get_filename(zip, i, raw, sizeof(raw)) >= sizeof(raw))
+            continue;
+
+        if (normalize(name, raw, sizeof(name)))
+            continue;
+
+        // the first one in the zip wins, same as locate_file did
+        IndexEntry *entry = index_table ? probe(index_table, index_capacity, hash_name(name), name) : NULL;
+        if (entry && entry->name && entry->mount == mount)
+            continue;
+
+        if (add_entry(name, mount, i, mz_zip_reader_is_file_a_directory(zip, i)))
+            return 1;
+    }
+
+    return 0;
+}
+
+// relative is already normalized, "" for the top
+static int index_folder(u32 mount, const char *relative) {
+    char path[PATH_MAX], child[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%s", mounts[mount].dir, relative);
+
+#ifdef _WIN32
+    char pattern[PATH_MAX];
+    snprintf(pattern, PATH_MAX, "%s\\*", path);
+
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(pattern, &found);
+
+    if (search == INVALID_HANDLE_VALUE)
+        return 0;
+
+    int result = 0;
+
+    do {
+        const char *name = found.cFileName;
+        bool directory = found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+#else
+    DIR *folder = opendir(path);
+
+    if (folder == NULL)
+        return 0;
+
+    int result = 0;
+    struct dirent *found;
+
+    while ((found = readdir(folder)) != NULL) {
+        const char *name = found->d_name;
+        bool directory = false;
+#endif
+
+        if (!strcmp(name, ".") || !strcmp(name, ".."))
+            continue;
+
+        if (snprintf(child, PATH_MAX, "%s%s%s", relative, *relative ? "/" : "", name) >= PATH_MAX)
+            continue;
+
+#ifndef _WIN32
+        char full_path[PATH_MAX];
+        snprintf(full_path, PATH_MAX, "%s/%s", mounts[mount].dir, child);
+
+        directory = is_directory(full_path) == 1;
+#endif
+
+        if (add_entry(child, mount, -1, directory) || (directory && index_folder(mount, child))) {
+            result = 1;
+            break;
+        }
+
+#ifdef _WIN32
+    } while (FindNextFileA(search, &found));
+
+    FindClose(search);
+#else
+    }
+
+    closedir(folder);
+#endif
+
+    return result;
+}
+
+// from scratch, lowest priority first so the later ones replace entries
+static int build_index() {
+    free_index();
+
+    for (u32 i = 0; i < mount_amount; i++) {
+        int failed = mounts[i].dir[0] ? index_folder(i, "") : index_zip(i);
+
+        if (failed) {
+            free_index();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static IndexEntry *find_entry(const char *name) {
+    char normal[PATH_MAX];
+
+    if (!index_table || normalize(normal, name, sizeof(normal)))
+        return NULL;
+
+    IndexEntry *entry = probe(index_table, index_capacity, hash_name(normal), normal);
+
+    return entry->name ? entry : NULL;
+}
+
+typedef struct {
+    Mount *mount;
+    i32 file;                // in the zip
+    char path[PATH_MAX];     // on disk
+} Resolved;
+
+// which mount has the file, non-zero if none
+static int resolve(const char *name, Resolved *out) {
+    IndexEntry *entry = find_entry(name);
+
+    if (entry) {
+        out->mount = &mounts[entry->mount];
+        out->file = entry->file;
+
+        if (entry->file == -1)
+            snprintf(out->path, PATH_MAX, "%s/%s", out->mount->dir, &names[entry->name-1]);
+
+        return 0;
+    }
+
+    // loose files can show up after mounting (pak_store, editors), the
+    // folders get a look too, top one first
+    for (u32 i = mount_amount; i-- > 0;) {
+        if (!mounts[i].dir[0])
+            continue;
+
+        snprintf(out->path, PATH_MAX, "%s/%s", mounts[i].dir, name);
+
+        if (is_directory(out->path) != -1) {
+            out->mount = &mounts[i];
+            out->file = -1;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void unmount(Mount *mount) {
+    if (mount->zip.m_archive_size)
+        mz_zip_reader_end(&mount->zip);
+
+    if (mount->file != NULL)
+        mmap_file_close(mount->file);
+
+    memset(mount, 0, sizeof(Mount));
+}
+
+static void pak_unmount() {
+    for (u32 i = 0; i < mount_amount; i++)
+        unmount(&mounts[i]);
+
+    mount_amount = 0;
+    free_index();
+}
+
+int pak_overlay(const char *name) {
     int is_dir = is_directory(name);
 
-    if (is_dir == -1) return 1;
+    if (is_dir == -1 || mount_amount >= MOUNT_AMOUNT) return 1;
 
-    if (is_dir) {
-        char real_path[PATH_MAX];
+    // has to happen in place, miniz keeps a pointer to the archive
+    Mount *mount = &mounts[mount_amount];
+    memset(mount, 0, sizeof(Mount));
 
+    if (is_dir) {
         // Resolve the real path
-        if (realpath(name, real_path) == NULL)
+        if (realpath(name, mount->dir) == NULL) {
+            unmount(mount);
+            return 1;
+        }
+    } else {
+        mount->file = mmap_file_open(name);
+        if (mount->file == NULL)
             return 1;
 
-        pak_unmount();
+        long start = find_zip_header(mount->file);
+        if (start == -1) {
+            unmount(mount);
+            return 1;
+        }
 
-        strncpy(mounted_dir, real_path, PATH_MAX - 1);
-        mounted_dir[PATH_MAX - 1] = '\0';
+        mount->archive = (const u8 *)mount->file->data + start;
+        mount->archive_size = mount->file->size - start;
 
-        return 0;
+        // Initialize the zip archive from memory
+        if (!mz_zip_reader_init_mem(&mount->zip, mount->archive, mount->archive_size, 0)) {
+            unmount(mount);
+            return 1;
+        }
     }
 
-    mmap_file *tmp_zip_file = mmap_file_open(name);
-    if (tmp_zip_file == NULL)
-        return 1;
+    mount_amount++;
 
-    long start = find_zip_header(tmp_zip_file);
-    if (start == -1)
+    if (build_index()) {
+        unmount(&mounts[--mount_amount]);
+        build_index();
         return 1;
+    }
 
-    char *data = (char*)(tmp_zip_file->data + start);
-    size_t size = tmp_zip_file->size - start;
+    return 0;
+}
+
+int pak_mount(const char *name) {
+    if (is_directory(name) == -1) return 1;
+
+    pak_unmount();
+    return pak_overlay(name);
+}
 
-    static mz_zip_archive tmp_zip_archive;
-    memset(&tmp_zip_archive, 0, sizeof(tmp_zip_archive));
+int pak_stat(const char *name, PakStat *out) {
+    PakStat _t;
 
-    // Initialize the zip archive from memory
-    if (!mz_zip_reader_init_mem(&tmp_zip_archive, data, size, 0)) {
-        mmap_file_close(tmp_zip_file);
+    if (out == NULL)
+        out = &_t;
+
+    *out = (PakStat) { 0 };
+
+    Resolved found;
+    if (resolve(name, &found))
         return 1;
+
+    if (found.file != -1) {
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&found.mount->zip, found.file, &stat))
+            return 1;
+
+        *out = (PakStat) {
+            .size = stat.m_uncomp_size,
+            .compressed = stat.m_comp_size,
+            .directory = stat.m_is_directory,
+        };
+
+        return 0;
     }
 
-    zip_archive = tmp_zip_archive;
-    zip_file = tmp_zip_file;
+    struct stat path_stat;
+    if (stat(found.path, &path_stat) != 0)
+        return 1;
 
-    return 1;
+    *out = (PakStat) {
+        .size = path_stat.st_size,
+        .compressed = path_stat.st_size,
+        .directory = S_ISDIR(path_stat.st_mode),
+    };
+
+    return 0;
 }
 
 char *pak_read(const char* name, size_t *size) {
@@ -231,20 +700,14 @@ char *pak_read(const char* name, size_t *size) {
 
     *size = 0;
 
-    if (zip_archive.m_archive_size) {
-        int idx = mz_zip_reader_locate_file(&zip_archive, name, NULL, 0);
-        if (idx == -1)
-            return NULL;
-
-        return mz_zip_reader_extract_to_heap(&zip_archive, idx, size, 0);
-    }
-
-    char full_path[PATH_MAX];
+    Resolved found;
+    if (resolve(name, &found))
+        return NULL;
 
-    // Construct the full path
-    snprintf(full_path, PATH_MAX, "%s/%s", mounted_dir, name);
+    if (found.file != -1)
+        return mz_zip_reader_extract_to_heap(&found.mount->zip, found.file, size, 0);
 
-    mmap_file *file = mmap_file_open(full_path);
+    mmap_file *file = mmap_file_open(found.path);
     if (file == NULL)
         return NULL;
 
@@ -258,3 +721,196 @@ char *pak_read(const char* name, size_t *size) {
 
     return buffer;
 }
+
+// into file->data if there is some, with room for a zero after, a new
+// buffer otherwise
+static int read_into(PakFile *file) {
+    Resolved found;
+    if (resolve(file->name, &found))
+        return 1;
+
+    if (!file->data) {
+        file->data = pak_read(file->name, &file->size);
+        return file->data == NULL;
+    }
+
+    if (found.file != -1) {
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&found.mount->zip, found.file, &stat))
+            return 1;
+
+        if (stat.m_uncomp_size >= file->capacity)
+            return 1;
+
+        if (!mz_zip_reader_extract_to_mem(&found.mount->zip, found.file, file->data, file->capacity, 0))
+            return 1;
+
+        file->size = stat.m_uncomp_size;
+        file->data[file->size] = 0;
+
+        return 0;
+    }
+
+    mmap_file *mapped = mmap_file_open(found.path);
+    if (mapped == NULL)
+        return 1;
+
+    bool fits = mapped->size < file->capacity;
+
+    if (fits) {
+        memcpy(file->data, mapped->data, mapped->size);
+        file->size = mapped->size;
+        file->data[file->size] = 0;
+    }
+
+    mmap_file_close(mapped);
+
+    return !fits;
+}
+
+static void read_job(void *userdata, u32 index) {
+    PakFile *file = &((PakFile *)userdata)[index];
+
+    file->size = 0;
+    file->failed = read_into(file);
+}
+
+u32 pak_read_batch(PakFile *files, u32 amount) {
+    job_parallel(read_job, files, amount);
+
+    u32 failed = 0;
+    for (u32 i = 0; i < amount; i++)
+        failed += files[i].failed != 0;
+
+    return failed;
+}
+
+enum { VIEW_NONE, VIEW_PACKAGE, VIEW_FILE, VIEW_HEAP };
+
+// where a stored entry's bytes sit in the mapping, or NULL if they have to
+// be inflated (or decrypted, or the headers look wrong)
+static const char *stored_data(Mount *mount, mz_zip_archive_file_stat *stat) {
+    if (stat->m_method != 0 || stat->m_is_encrypted || stat->m_comp_size != stat->m_uncomp_size)
+        return NULL;
+
+    size_t offset = stat->m_local_header_ofs;
+
+    if (offset + 30 > mount->archive_size)
+        return NULL;
+
+    const u8 *header = mount->archive + offset;
+
+    if (memcmp(header, "\x50\x4b\x03\x04", 4) != 0)
+        return NULL;
+
+    // the local header has its own name and extra lengths, they don't
+    // have to match the central directory ones
+    size_t name_length = header[26] | header[27] << 8;
+    size_t extra_length = header[28] | header[29] << 8;
+
+    offset += 30 + name_length + extra_length;
+
+    if (offset > mount->archive_size || stat->m_uncomp_size > mount->archive_size - offset)
+        return NULL;
+
+    return (const char *)mount->archive + offset;
+}
+
+int pak_map(const char *name, PakView *out) {
+    *out = (PakView) { 0 };
+
+    Resolved found;
+    if (resolve(name, &found))
+        return 1;
+
+    if (found.file != -1) {
+        mz_zip_archive *zip = &found.mount->zip;
+
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(zip, found.file, &stat) || stat.m_is_directory)
+            return 1;
+
+        const char *stored = stored_data(found.mount, &stat);
+
+        if (stored) {
+            *out = (PakView) { stored, stat.m_uncomp_size, NULL, VIEW_PACKAGE };
+            return 0;
+        }
+
+        size_t size;
+        char *data = mz_zip_reader_extract_to_heap(zip, found.file, &size, 0);
+
+        if (!data)
+            return 1;
+
+        *out = (PakView) { data, size, data, VIEW_HEAP };
+        return 0;
+    }
+
+    mmap_file *file = mmap_file_open(found.path);
+    if (file == NULL)
+        return 1;
+
+    *out = (PakView) { file->data, file->size, file, VIEW_FILE };
+    return 0;
+}
+
+void pak_unmap(PakView *view) {
+    if (view->kind == VIEW_FILE)
+        mmap_file_close(view->owner);
+
+    if (view->kind == VIEW_HEAP)
+        free(view->owner);
+
+    *view = (PakView) { 0 };
+}
+
+static int store_file(const char *package, const char *name, const char *data, size_t size) {
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s", package, name);
+
+    FILE *file = fopen(full_path, "wb");
+    if (file == NULL)
+        return 1;
+
+    size_t written = fwrite(data, 1, size, file);
+    fclose(file);
+
+    return written != size;
+}
+
+// existing entries with the same name aren't replaced, the new one just
+// ends up after them.
+static int store_zip(const char *package, const char *name, const char *data, size_t size) {
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+
+    if (is_directory(package) == 0) {
+        if (!mz_zip_reader_init_file(&zip, package, 0))
+            return 1;
+
+        if (!mz_zip_writer_init_from_reader(&zip, package)) {
+            mz_zip_reader_end(&zip);
+            return 1;
+        }
+    } else if (!mz_zip_writer_init_file(&zip, package, 0)) {
+        return 1;
+    }
+
+    bool ok = mz_zip_writer_add_mem(&zip, name, data, size, MZ_DEFAULT_COMPRESSION);
+    ok = mz_zip_writer_finalize_archive(&zip) && ok;
+
+    mz_zip_writer_end(&zip);
+
+    return !ok;
+}
+
+int pak_store(const char *package, const char *name, const char *data, size_t size) {
+    if (!package || !name || (!data && size))
+        return 1;
+
+    if (is_directory(package) == 1)
+        return store_file(package, name, data, size);
+
+    return store_zip(package, name, data, size);
+}
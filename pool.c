@@ -1,106 +1,465 @@
 #include "basket.h"
 #include "float.h"
+#include "math.h"
 #include "stdlib.h"
+#include "string.h"
 
-// This implements an incomplete BVH structure, specialized for triangles
+// This implements a BVH structure, specialized for triangles.
+// Nodes live in one flat array, children of a node sit next to each
+// other, and every node covers a contiguous run of triangles, since
+// the triangles get sorted in place while building.
 
-static void expand_box(Box* box, const Vertex* v) {
+#define BINS 12
+#define LEAF_TRIANGLES 4
+#define STACK_SIZE 64
+
+static void expand_box(Box* box, const f32 p[3]) {
+    for (int i = 0; i < 3; i++) {
+        if (p[i] < box->min[i]) box->min[i] = p[i];
+        if (p[i] > box->max[i]) box->max[i] = p[i];
+    }
+}
+
+static void merge_box(Box* box, const Box* other) {
     for (int i = 0; i < 3; i++) {
-        if (v->position[i] < box->min[i]) box->min[i] = v->position[i];
-        if (v->position[i] > box->max[i]) box->max[i] = v->position[i];
+        box->min[i] = min(box->min[i], other->min[i]);
+        box->max[i] = max(box->max[i], other->max[i]);
     }
 }
 
-static Box calculate_box(Triangle* triangles, int count) {
-    Box box = {
-        .min = { FLT_MAX,  FLT_MAX,  FLT_MAX}, 
+static Box empty_box(void) {
+    return (Box) {
+        .min = { FLT_MAX,  FLT_MAX,  FLT_MAX},
         .max = {-FLT_MAX, -FLT_MAX, -FLT_MAX}
     };
+}
 
-    for (int i = 0; i < count; ++i) {
-        expand_box(&box, &triangles[i].a);
-        expand_box(&box, &triangles[i].b);
-        expand_box(&box, &triangles[i].c);
-    }
+static f32 box_area(const Box* box) {
+    f32 d[3];
+
+    for (int i = 0; i < 3; i++)
+        d[i] = max(box->max[i] - box->min[i], 0.0f);
+
+    return d[0]*d[1] + d[1]*d[2] + d[2]*d[0];
+}
+
+static f32 centroid(const Triangle* t, int axis) {
+    return (
+        t->a.position[axis] +
+        t->b.position[axis] +
+        t->c.position[axis]
+    ) / 3.0f;
+}
+
+static Box triangle_box(const Triangle* t) {
+    Box box = empty_box();
+
+    for (int i = 0; i < 3; i++)
+        expand_box(&box, t->arr[i].position);
 
     return box;
 }
 
-static void split_triangles(Triangle* triangles, int count, int axis, int* mid) {
-    float mid_point = 0.0f;
+typedef struct {
+    Box bounds;
+    u32 amount;
+} Bin;
+
+// binned SAH, returns false if the triangles should stay a leaf
+static bool find_split(Triangle* triangles, u32 count, Box* bounds, int* axis, f32* split) {
+    Box centroids = empty_box();
+
+    for (u32 i = 0; i < count; i++) {
+        f32 c[3] = {
+            centroid(&triangles[i], 0),
+            centroid(&triangles[i], 1),
+            centroid(&triangles[i], 2)
+        };
+
+        expand_box(&centroids, c);
+    }
+
+    f32 best = FLT_MAX;
 
-    for (int i = 0; i < count; ++i) {
-        mid_point += (
-            triangles[i].a.position[axis] + 
-            triangles[i].b.position[axis] + 
-            triangles[i].c.position[axis]
-        ) / 3.0f;
+    for (int a = 0; a < 3; a++) {
+        f32 low = centroids.min[a], high = centroids.max[a];
+
+        if (high <= low)
+            continue;
+
+        Bin bins[BINS];
+        for (int b = 0; b < BINS; b++)
+            bins[b] = (Bin) { empty_box(), 0 };
+
+        f32 scale = BINS / (high - low);
+
+        for (u32 i = 0; i < count; i++) {
+            int b = min((int)((centroid(&triangles[i], a) - low) * scale), BINS - 1);
+            Box t = triangle_box(&triangles[i]);
+
+            merge_box(&bins[b].bounds, &t);
+            bins[b].amount++;
+        }
+
+        // sweep from the right first, so the left sweep can price every plane
+        f32 right_cost[BINS];
+        Box right = empty_box();
+        u32 right_amount = 0;
+
+        for (int b = BINS - 1; b > 0; b--) {
+            merge_box(&right, &bins[b].bounds);
+            right_amount += bins[b].amount;
+            right_cost[b] = right_amount ? box_area(&right) * right_amount : 0.0f;
+        }
+
+        Box left = empty_box();
+        u32 left_amount = 0;
+
+        for (int b = 0; b < BINS - 1; b++) {
+            merge_box(&left, &bins[b].bounds);
+            left_amount += bins[b].amount;
+
+            if (!left_amount || left_amount == count)
+                continue;
+
+            f32 cost = box_area(&left) * left_amount + right_cost[b+1];
+
+            if (cost < best) {
+                best = cost;
+                *axis = a;
+                *split = low + (b + 1) / scale;
+            }
+        }
     }
 
-    mid_point /= count;
-
-    int left = 0;
-    int right = count - 1;
-
-    while (left <= right) {
-        while (
-            (
-                triangles[left].a.position[axis] + 
-                triangles[left].b.position[axis] + 
-                triangles[left].c.position[axis]
-            ) / 3.0f < mid_point) 
-                left++;
-
-        while (
-            (
-                triangles[right].a.position[axis] + 
-                triangles[right].b.position[axis] + 
-                triangles[right].c.position[axis]
-            ) / 3.0f >= mid_point) 
-                right--;
-        
-        if (left <= right) {
+    if (best == FLT_MAX || count <= LEAF_TRIANGLES)
+        return false;
+
+    // splitting has to beat just testing every triangle
+    return count > LEAF_TRIANGLES*4 || best < box_area(bounds) * count;
+}
+
+static u32 partition(Triangle* triangles, u32 count, int axis, f32 split) {
+    u32 left = 0, right = count;
+
+    while (left < right) {
+        if (centroid(&triangles[left], axis) < split) {
+            left++;
+        } else {
+            right--;
+
             Triangle temp = triangles[left];
             triangles[left] = triangles[right];
             triangles[right] = temp;
-            left++;
-            right--;
         }
     }
 
-    *mid = left;
+    return left;
 }
 
-static int build_bvh(VertexPool* node, Triangle* triangles, int count, int depth) {
-    if (count == 0) 
+static void build_node(VertexPool* pool, u32 index, u32 first, u32 count) {
+    PoolNode* node = &pool->nodes[index];
+    Triangle* triangles = &pool->triangles[first];
+
+    node->first = first;
+    node->amount = count;
+    node->left = 0;
+    node->bounds = empty_box();
+
+    for (u32 i = 0; i < count; i++) {
+        Box t = triangle_box(&triangles[i]);
+        merge_box(&node->bounds, &t);
+    }
+
+    if (count <= 1)
+        return;
+
+    int axis;
+    f32 split;
+
+    if (!find_split(triangles, count, &node->bounds, &axis, &split))
+        return;
+
+    u32 mid = partition(triangles, count, axis, split);
+
+    // the bins and the partition can disagree right at a boundary
+    if (mid == 0 || mid == count)
+        mid = count / 2;
+
+    u32 left = pool->node_amount;
+    pool->node_amount += 2;
+
+    node->left = left;
+
+    build_node(pool, left, first, mid);
+    build_node(pool, left + 1, first + mid, count - mid);
+}
+
+int pool_init(VertexPool* pool, Triangle* triangles, u32 count) {
+    *pool = (VertexPool) { 0 };
+
+    if (count == 0)
         return 1;
 
-    node = (VertexPool*)calloc(1, sizeof(VertexPool));
-    node->bounds = calculate_box(triangles, count);
-    node->triangles = triangles;
-    node->triangle_count = count;
+    // a binary tree with at least one triangle per leaf can't get bigger
+    pool->nodes = malloc(sizeof(PoolNode) * (count * 2 - 1));
 
-    if (count <= 2) 
-        return 0;
+    if (!pool->nodes)
+        return 1;
 
-    int axis = depth % 3;
-    int mid;
-    split_triangles(triangles, count, axis, &mid);
+    pool->triangles = triangles;
+    pool->triangle_count = count;
+    pool->node_amount = 1;
 
-    build_bvh(node->left, triangles, mid, depth + 1);
-    build_bvh(node->right, triangles + mid, count - mid, depth + 1);
+    build_node(pool, 0, 0, count);
+
+    PoolNode* shrunk = realloc(pool->nodes, sizeof(PoolNode) * pool->node_amount);
+    if (shrunk)
+        pool->nodes = shrunk;
 
     return 0;
 }
 
+void pool_free(VertexPool* pool) {
+    if (pool->nodes)
+        free(pool->nodes);
 
-int pool_init(VertexPool* pool, Triangle* triangles, u32 count) {
-    return build_bvh(pool, triangles, count, 0);
+    *pool = (VertexPool) { 0 };
 }
 
-void pool_free(VertexPool* node) {
-    if (node) {
-        pool_free(node->left);
-        pool_free(node->right);
+// QUERIES
+
+// glue runs that touch into one, leaves next to each other usually do
+static u32 push_range(Range* out, u32 amount, u32 capacity, u32 first, u32 length) {
+    if (amount && out[amount-1].offset + out[amount-1].length == first) {
+        out[amount-1].length += length;
+        return amount;
+    }
+
+    // out of room, grow the last one over it instead of losing triangles.
+    // it takes in some that weren't asked for, culling stays conservative
+    if (amount >= capacity) {
+        if (amount) {
+            Range *last = &out[amount-1];
+            u32 start = min(last->offset, first);
+            u32 end = max(last->offset + last->length, first + length);
+            *last = (Range) { start, end - start };
+        }
+        return amount;
+    }
+
+    out[amount] = (Range) { first, length };
+    return amount + 1;
+}
+
+enum { OUTSIDE, INTERSECTS, INSIDE };
+
+static int classify(const Frustum* f, const Box* box) {
+    const f32* planes[6] = { f->left, f->right, f->top, f->bottom, f->near, f->far };
+    int result = INSIDE;
+
+    for (int i = 0; i < 6; i++) {
+        const f32* p = planes[i];
+        f32 most[3], least[3];
+
+        for (int k = 0; k < 3; k++) {
+            most[k]  = p[k] > 0.0f ? box->max[k] : box->min[k];
+            least[k] = p[k] > 0.0f ? box->min[k] : box->max[k];
+        }
+
+        if (vec_dot(p, most, 3) + p[3] < 0.0f)
+            return OUTSIDE;
+
+        if (vec_dot(p, least, 3) + p[3] < 0.0f)
+            result = INTERSECTS;
     }
-}
\ No newline at end of file
+
+    return result;
+}
+
+u32 pool_frustum(VertexPool* pool, Frustum frustum, Range* out, u32 capacity) {
+    if (!pool->nodes || !capacity)
+        return 0;
+
+    u32 stack[STACK_SIZE];
+    u32 depth = 0, amount = 0;
+
+    stack[depth++] = 0;
+
+    while (depth) {
+        PoolNode* node = &pool->nodes[stack[--depth]];
+        int side = classify(&frustum, &node->bounds);
+
+        if (side == OUTSIDE)
+            continue;
+
+        // no need to look any further if all of it is visible
+        if (side == INSIDE || !node->left || depth + 2 > STACK_SIZE) {
+            amount = push_range(out, amount, capacity, node->first, node->amount);
+            continue;
+        }
+
+        stack[depth++] = node->left + 1;
+        stack[depth++] = node->left;
+    }
+
+    return amount;
+}
+
+static bool boxes_overlap(const Box* a, const Box* b) {
+    for (int i = 0; i < 3; i++) {
+        if (a->max[i] < b->min[i] || a->min[i] > b->max[i])
+            return false;
+    }
+
+    return true;
+}
+
+u32 pool_overlap(VertexPool* pool, Box box, Range* out, u32 capacity) {
+    if (!pool->nodes || !capacity)
+        return 0;
+
+    u32 stack[STACK_SIZE];
+    u32 depth = 0, amount = 0;
+
+    stack[depth++] = 0;
+
+    while (depth) {
+        PoolNode* node = &pool->nodes[stack[--depth]];
+
+        if (!boxes_overlap(&node->bounds, &box))
+            continue;
+
+        if (node->left && depth + 2 <= STACK_SIZE) {
+            stack[depth++] = node->left + 1;
+            stack[depth++] = node->left;
+            continue;
+        }
+
+        for (u32 i = node->first; i < node->first + node->amount; i++) {
+            Box t = triangle_box(&pool->triangles[i]);
+
+            if (boxes_overlap(&t, &box))
+                amount = push_range(out, amount, capacity, i, 1);
+        }
+    }
+
+    return amount;
+}
+
+// slab test, returns the distance where the ray enters, or FLT_MAX
+static f32 ray_box(const f32 origin[3], const f32 inverse[3], const Box* box, f32 limit) {
+    f32 enter = 0.0f, leave = limit;
+
+    for (int i = 0; i < 3; i++) {
+        // parallel to this axis, 0 * inf would be nan right on a face
+        if (isinf(inverse[i])) {
+            if (origin[i] < box->min[i] || origin[i] > box->max[i])
+                return FLT_MAX;
+
+            continue;
+        }
+
+        f32 t0 = (box->min[i] - origin[i]) * inverse[i];
+        f32 t1 = (box->max[i] - origin[i]) * inverse[i];
+
+        enter = max(enter, min(t0, t1));
+        leave = min(leave, max(t0, t1));
+    }
+
+    return enter <= leave ? enter : FLT_MAX;
+}
+
+// möller-trumbore, both sides count
+static bool ray_triangle(const f32 origin[3], const f32 direction[3], const Triangle* t, f32* distance) {
+    f32 e1[3], e2[3], p[3], s[3], q[3];
+
+    vec_sub(e1, (f32 *)t->b.position, (f32 *)t->a.position, 3);
+    vec_sub(e2, (f32 *)t->c.position, (f32 *)t->a.position, 3);
+
+    vec3_cross(p, direction, e2);
+    f32 det = vec_dot(e1, p, 3);
+
+    if (det > -FLT_EPSILON && det < FLT_EPSILON)
+        return false;
+
+    f32 inv = 1.0f / det;
+
+    vec_sub(s, (f32 *)origin, (f32 *)t->a.position, 3);
+    f32 u = vec_dot(s, p, 3) * inv;
+
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    vec3_cross(q, s, e1);
+    f32 v = vec_dot(direction, q, 3) * inv;
+
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    f32 d = vec_dot(e2, q, 3) * inv;
+
+    if (d < 0.0f)
+        return false;
+
+    *distance = d;
+    return true;
+}
+
+bool pool_raycast(VertexPool* pool, f32 origin[3], f32 direction[3], f32* distance, u32* triangle) {
+    if (!pool->nodes)
+        return false;
+
+    f32 inverse[3];
+    for (int i = 0; i < 3; i++)
+        inverse[i] = 1.0f / direction[i];
+
+    f32 closest = FLT_MAX;
+    u32 hit = 0;
+    bool found = false;
+
+    u32 stack[STACK_SIZE];
+    u32 depth = 0;
+
+    stack[depth++] = 0;
+
+    while (depth) {
+        PoolNode* node = &pool->nodes[stack[--depth]];
+
+        if (ray_box(origin, inverse, &node->bounds, closest) == FLT_MAX)
+            continue;
+
+        if (node->left && depth + 2 <= STACK_SIZE) {
+            f32 a = ray_box(origin, inverse, &pool->nodes[node->left].bounds, closest);
+            f32 b = ray_box(origin, inverse, &pool->nodes[node->left + 1].bounds, closest);
+
+            // visit the nearer child first, so more of the other gets skipped
+            if (a <= b) {
+                stack[depth++] = node->left + 1;
+                stack[depth++] = node->left;
+            } else {
+                stack[depth++] = node->left;
+                stack[depth++] = node->left + 1;
+            }
+
+            continue;
+        }
+
+        for (u32 i = node->first; i < node->first + node->amount; i++) {
+            f32 d;
+
+            if (ray_triangle(origin, direction, &pool->triangles[i], &d) && d < closest) {
+                closest = d;
+                hit = i;
+                found = true;
+            }
+        }
+    }
+
+    if (found) {
+        if (distance) *distance = closest;
+        if (triangle) *triangle = hit;
+    }
+
+    return found;
+}
@@ -23,9 +23,20 @@ static int width, height;
 typedef vec_t(Vertex) VertexVec;
 typedef vec_t(RenderCall) CallVec;
 typedef vec_t(Light) LightVec;
+typedef vec_t(Instance) InstanceVec;
+typedef vec_t(Texture) TextureVec;
+
+typedef struct {
+    RenderCall call;
+    u32 first, amount; // into instances
+} InstancedCall;
+
+typedef vec_t(InstancedCall) InstancedVec;
 
 static vec_char_t logs;
 static CallVec calls;
+static InstancedVec instanced_calls;
+static InstanceVec instances;
 static CallVec flat_calls;
 static VertexVec transient;
 static LightVec lights;
@@ -45,6 +56,12 @@ static tfx_uniform scale_uniform;
 static tfx_uniform lposition_uniform;
 static tfx_uniform lcolor_uniform;
 static tfx_uniform lamount_uniform;
+static tfx_uniform model_view_uniform;
+static tfx_uniform tint_uniform;
+static tfx_uniform uv_rect_uniform;
+static tfx_uniform bones_uniform;
+static tfx_uniform skinned_uniform;
+static tfx_uniform unpack_uniform;
 
 static tfx_program program;
 static tfx_program out_program;
@@ -61,6 +78,9 @@ static bool was_debug = false;
 static bool resize;
 
 static tfx_vertex_format vertex_format;
+static tfx_vertex_format skinned_format;
+static tfx_vertex_format packed_format;
+static tfx_vertex_format packed_skinned_format;
 static f32 view_matrix[16] = IDENTITY_MATRIX;
 static f32 proj_matrix[16] = IDENTITY_MATRIX;
 
@@ -119,10 +139,73 @@ void ren_videomode(u16 w, u16 h, bool force_ratio) {
 #define TEXTURE_AMOUNT 128
 static tfx_texture textures[TEXTURE_AMOUNT];
 static tfx_texture texture_none;
-static tfx_texture texture_main;
-static tfx_texture texture_lumos;
+static Texture bound_main, bound_lumos;
+static bool texture_s3tc;
+
+// what calls get to see, streamed textures are this big long before the
+// full size level is actually up
+static u16 texture_w[TEXTURE_AMOUNT], texture_h[TEXTURE_AMOUNT];
+
+// streamed ones that couldn't be decoded, they stay empty until freed
+static bool texture_failed[TEXTURE_AMOUNT];
+
+// Streamed textures get decoded on a worker, then go up smallest level
+// first, a few per frame, each one replacing the last.
+#define STREAM_LEVELS 4            // full size and a few halvings of it
+#define STREAM_SMALLEST 32         // no point in levels smaller than this
+#define STREAM_BUDGET (4u << 20)   // bytes per frame, one level always goes
+
+typedef struct {
+    Texture id; // 0 once ren_tex_free got to it first
+
+    char *data;
+    u32 length;
+
+    Image levels[STREAM_LEVELS]; // full size first
+    u32 level_amount;
+    u32 uploaded;
+    bool failed;
+
+    SDL_atomic_t decoded;
+} Stream;
+
+typedef vec_t(Stream *) StreamVec;
+static StreamVec streams;
+
+static Texture texture_slot(tfx_texture texture, u16 w, u16 h) {
+    for (int i = 0; i < TEXTURE_AMOUNT; i++) {
+        if (!textures[i].gl_count) {
+            textures[i] = texture;
+            texture_w[i] = w;
+            texture_h[i] = h;
+            texture_failed[i] = false;
+            return i+1;
+        }
+    }
+
+    tfx_texture_free(&texture);
+    return 0;
+}
+
+// the gpu takes the blocks as they are, no decoding at all
+static Texture load_compressed(CompressedImage image) {
+    tfx_format format = image.format == IMG_FORMAT_BC1 ? TFX_FORMAT_BC1 : TFX_FORMAT_BC3;
+
+    tfx_texture texture = tfx_texture_new(
+        image.w, image.h, 1, image.blocks,
+        format, TFX_TEXTURE_FILTER_POINT
+    );
+
+    return texture_slot(texture, image.w, image.h);
+}
 
 u8 ren_tex_load(const char *data, u32 length) {
+    if (!set_up) return 0;
+
+    CompressedImage compressed;
+    if (texture_s3tc && !img_compressed(&compressed, data, length))
+        return load_compressed(compressed);
+
     Image tex;
     if (img_init(&tex, data, length))
         return 0;
@@ -133,26 +216,169 @@ u8 ren_tex_load(const char *data, u32 length) {
     return id;
 }
 
+bool ren_tex_compressed(void) {
+    return set_up && texture_s3tc;
+}
+
 u8 ren_tex_load_custom(Image img) {
     if (!set_up) return 0;
 
-    for (int i = 0; i < TEXTURE_AMOUNT; i++) {
-        if (!textures[i].gl_count) {
-            textures[i] = tfx_texture_new(
-                img.w, img.h, 1, img.pixels,
+    tfx_texture texture = tfx_texture_new(
+        img.w, img.h, 1, img.pixels,
+        TFX_FORMAT_RGBA8, TFX_TEXTURE_FILTER_POINT
+    );
+
+    return texture_slot(texture, img.w, img.h);
+}
+
+static void stream_job(void *userdata, u32 index) {
+    (void)index;
+    Stream *stream = userdata;
+
+    stream->failed = img_init(&stream->levels[0], stream->data, stream->length);
+
+    free(stream->data);
+    stream->data = NULL;
+
+    if (!stream->failed) {
+        stream->level_amount = 1;
+
+        while (stream->level_amount < STREAM_LEVELS) {
+            Image *last = &stream->levels[stream->level_amount - 1];
+
+            if (max(last->w, last->h) / 2 < STREAM_SMALLEST)
+                break;
+
+            if (img_half(&stream->levels[stream->level_amount], *last))
+                break;
+
+            stream->level_amount++;
+        }
+    }
+
+    SDL_AtomicSet(&stream->decoded, 1);
+}
+
+Texture ren_tex_stream(const char *data, u32 length) {
+    if (!set_up) return 0;
+
+    CompressedImage compressed;
+    if (texture_s3tc && !img_compressed(&compressed, data, length))
+        return load_compressed(compressed);
+
+    u16 w, h;
+    if (img_info(data, length, &w, &h))
+        return 0;
+
+    Stream *stream = calloc(1, sizeof(Stream));
+    if (!stream)
+        return 0;
+
+    stream->data = malloc(length);
+    if (!stream->data) {
+        free(stream);
+        return 0;
+    }
+
+    memcpy(stream->data, data, length);
+    stream->length = length;
+
+    Color transparent = {0, 0, 0, 0};
+    tfx_texture placeholder = tfx_texture_new(1, 1, 1, &transparent, TFX_FORMAT_RGBA8, 0);
+
+    stream->id = texture_slot(placeholder, w, h);
+    if (!stream->id) {
+        free(stream->data);
+        free(stream);
+        return 0;
+    }
+
+    vec_push(&streams, stream);
+    job_push(stream_job, stream);
+
+    return stream->id;
+}
+
+bool ren_tex_ready(Texture id) {
+    if (!set_up || !id || id > TEXTURE_AMOUNT) return false;
+
+    if (!textures[id-1].gl_count || texture_failed[id-1])
+        return false;
+
+    for (int i = 0; i < streams.length; i++)
+        if (streams.data[i]->id == id)
+            return false;
+
+    return true;
+}
+
+bool ren_tex_failed(Texture id) {
+    if (!set_up || !id || id > TEXTURE_AMOUNT) return false;
+
+    return textures[id-1].gl_count && texture_failed[id-1];
+}
+
+static void free_stream(Stream *stream) {
+    for (u32 i = 0; i < stream->level_amount; i++)
+        img_free(&stream->levels[i]);
+
+    free(stream->data);
+    free(stream);
+}
+
+static void stream_textures(void) {
+    u32 budget = STREAM_BUDGET;
+    bool uploaded = false;
+
+    for (int i = 0; i < streams.length;) {
+        Stream *stream = streams.data[i];
+
+        if (!SDL_AtomicGet(&stream->decoded)) {
+            i++;
+            continue;
+        }
+
+        if (stream->failed && stream->id)
+            texture_failed[stream->id-1] = true;
+
+        if (stream->id && stream->uploaded < stream->level_amount) {
+            Image level = stream->levels[stream->level_amount - 1 - stream->uploaded];
+            u32 size = level.w * level.h * sizeof(Color);
+
+            if (size > budget && uploaded) {
+                i++;
+                continue;
+            }
+
+            budget -= min(size, budget);
+            uploaded = true;
+
+            tfx_texture_free(&textures[stream->id-1]);
+            textures[stream->id-1] = tfx_texture_new(
+                level.w, level.h, 1, level.pixels,
                 TFX_FORMAT_RGBA8, TFX_TEXTURE_FILTER_POINT
             );
-            return i+1;
+
+            // one level per frame each, the rest can wait
+            if (++stream->uploaded < stream->level_amount) {
+                i++;
+                continue;
+            }
         }
-    }
 
-    return 0;
+        free_stream(stream);
+        vec_splice(&streams, i, 1);
+    }
 }
 
 void ren_tex_free(u8 id) {
     if (!set_up) return;
     if (!id) return;
 
+    for (int i = 0; i < streams.length; i++)
+        if (streams.data[i]->id == id)
+            streams.data[i]->id = 0;
+
     id -= 1;
 
     if (!textures[id].gl_count)
@@ -160,17 +386,231 @@ void ren_tex_free(u8 id) {
 
     tfx_texture_free(&textures[id]);
     textures[id].gl_count = 0;
+    texture_w[id] = 0;
+    texture_h[id] = 0;
+    texture_failed[id] = false;
 }
 
 void ren_tex_bind(u8 main, u8 lumos) {
-    texture_main = texture_none;
-    texture_lumos = texture_none;
+    bound_main = main;
+    bound_lumos = lumos;
+}
+
+static tfx_texture *texture_of(Texture id) {
+    if (id && id <= TEXTURE_AMOUNT && textures[id-1].gl_count)
+        return &textures[id-1];
+
+    return &texture_none;
+}
+
+static void texture_size(Texture id, f32 *w, f32 *h) {
+    *w = texture_none.width;
+    *h = texture_none.height;
+
+    if (id && id <= TEXTURE_AMOUNT && textures[id-1].gl_count) {
+        *w = texture_w[id-1];
+        *h = texture_h[id-1];
+    }
+}
+
+// calls remember what was bound when they came in
+static void capture_textures(RenderCall *call) {
+    if (call->image || call->lumos)
+        return;
+
+    call->image = bound_main;
+    call->lumos = bound_lumos;
+}
+
+#define BUFFER_AMOUNT 1024
+#define INSTANCE_AMOUNT 16 // per draw, same as in shader.glsl (1 in compat mode)
+#define BONE_AMOUNT 64      // same as in shader.glsl
+static tfx_buffer buffers[BUFFER_AMOUNT];
+static tfx_buffer index_buffers[BUFFER_AMOUNT]; // gl_id 0 if not indexed
+static u32 buffer_lengths[BUFFER_AMOUNT];       // in triangle corners, lods too
+static u32 buffer_triangles[BUFFER_AMOUNT];     // what a call without a range draws
+static bool buffer_skinned[BUFFER_AMOUNT];
+static u32 buffer_bones[BUFFER_AMOUNT];         // past the highest bone a vertex uses
+
+// how a buffer's vertices get back to floats, nothing to do unless packed
+typedef struct {
+    f32 position[2][4]; // offset, scale, like the unpack uniform
+    f32 uv[4];          // scale, offset, like uv_rect
+} Unpack;
+
+static const Unpack no_unpack = {
+    { { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+    { 1.0f, 1.0f, 0.0f, 0.0f }
+};
+
+static Unpack buffer_unpack[BUFFER_AMOUNT];
+
+// what ren_buf_load_packed puts in buffers, 16 instead of 24 bytes.
+// animated meshes have their VertexAnim right after either kind.
+typedef struct {
+    u16 position[4]; // in the box, w is only there to keep things aligned
+    u16 uv[2];       // in the mesh's uv range
+    Color color;
+} PackedVertex;
+
+// 16 bit ones when the vertices fit, half of the memory
+static tfx_buffer index_buffer(MeshSlice mesh) {
+    u32 amount = msh_triangles(mesh)*3 + mesh.lod_index_amount;
+
+    if (mesh.length > 0xFFFF)
+        return tfx_buffer_new(mesh.indices, sizeof(u32) * amount, NULL, TFX_BUFFER_INDEX_32);
+
+    u16 *narrow = falloc(u16, amount);
+
+    for (u32 i = 0; i < amount; i++)
+        narrow[i] = mesh.indices[i];
+
+    tfx_buffer buffer = tfx_buffer_new(narrow, sizeof(u16) * amount, NULL, TFX_BUFFER_NONE);
+    free(narrow);
+
+    return buffer;
+}
+
+static Unpack unpack_of(MeshSlice mesh) {
+    Unpack unpack = no_unpack;
+
+    f32 low[2]  = { mesh.data[0].uv[0], mesh.data[0].uv[1] };
+    f32 high[2] = { low[0], low[1] };
+
+    for (u32 v = 1; v < mesh.length; v++) {
+        for (int c = 0; c < 2; c++) {
+            low[c]  = min(low[c],  mesh.data[v].uv[c]);
+            high[c] = max(high[c], mesh.data[v].uv[c]);
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        unpack.position[0][c] = mesh.box.min[c];
+        unpack.position[1][c] = mesh.box.max[c] - mesh.box.min[c];
+    }
+
+    for (int c = 0; c < 2; c++) {
+        unpack.uv[c]   = high[c] - low[c];
+        unpack.uv[c+2] = low[c];
+    }
+
+    return unpack;
+}
+
+static u16 quantize(f32 value, f32 offset, f32 scale) {
+    if (scale <= 0.0f)
+        return 0;
+
+    return (u16)(clamp((value - offset) / scale, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+static PackedVertex pack_vertex(const Unpack *unpack, const Vertex *vertex) {
+    PackedVertex packed = { .color = vertex->color };
+
+    for (int c = 0; c < 3; c++)
+        packed.position[c] = quantize(vertex->position[c], unpack->position[0][c], unpack->position[1][c]);
+
+    for (int c = 0; c < 2; c++)
+        packed.uv[c] = quantize(vertex->uv[c], unpack->uv[c+2], unpack->uv[c]);
+
+    return packed;
+}
+
+static Buffer load_buffer(MeshSlice mesh, bool packed) {
+    if (!set_up) return 0;
+    if (!mesh.data || !mesh.length) return 0;
+
+    for (int i = 0; i < BUFFER_AMOUNT; i++) {
+        if (buffers[i].gl_id)
+            continue;
+
+        Unpack unpack = packed ? unpack_of(mesh) : no_unpack;
+
+        tfx_vertex_format *format = packed ? &packed_format : &vertex_format;
+        size_t size = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+
+        if (mesh.animation) {
+            format = packed ? &packed_skinned_format : &skinned_format;
+            size += sizeof(VertexAnim);
+        }
+
+        u8 *data = falloc(u8, size * mesh.length);
+        u32 bones = 0;
+
+        for (u32 v = 0; v < mesh.length; v++) {
+            u8 *out = &data[size * v];
+
+            // ren_frame hands colors over as r, g, b, a, so match that
+            Vertex vertex = mesh.data[v];
+            Color c = vertex.color;
+            vertex.color = (Color) { c.r, c.g, c.b, c.a };
+
+            if (packed) {
+                PackedVertex small = pack_vertex(&unpack, &vertex);
+                memcpy(out, &small, sizeof(PackedVertex));
+            } else {
+                memcpy(out, &vertex, sizeof(Vertex));
+            }
+
+            if (mesh.animation) {
+                memcpy(out + size - sizeof(VertexAnim), &mesh.animation[v], sizeof(VertexAnim));
+
+                // the shader reads bones[] even for zero weights
+                for (int k = 0; k < 4; k++)
+                    bones = max(bones, mesh.animation[v].bone[k] + 1u);
+            }
+        }
+
+        buffers[i] = tfx_buffer_new(data, size * mesh.length, format, TFX_BUFFER_NONE);
+        free(data);
+
+        buffer_lengths[i] = mesh.length;
+        buffer_skinned[i] = mesh.animation != NULL;
+        buffer_bones[i] = bones;
+        buffer_unpack[i] = unpack;
+
+        if (mesh.indices) {
+            index_buffers[i] = index_buffer(mesh);
+            buffer_lengths[i] = msh_triangles(mesh)*3 + mesh.lod_index_amount;
+        }
 
-    if (main && textures[main-1].gl_count)
-        texture_main = textures[main-1];
+        buffer_triangles[i] = msh_triangles(mesh);
 
-    if (lumos && textures[lumos-1].gl_count)
-        texture_lumos = textures[lumos-1];
+        return i+1;
+    }
+
+    return 0;
+}
+
+Buffer ren_buf_load(MeshSlice mesh) {
+    return load_buffer(mesh, false);
+}
+
+Buffer ren_buf_load_packed(MeshSlice mesh) {
+    return load_buffer(mesh, true);
+}
+
+void ren_buf_free(Buffer id) {
+    if (!set_up) return;
+    if (!id) return;
+
+    id -= 1;
+
+    if (!buffers[id].gl_id)
+        return;
+
+    tfx_buffer_free(&buffers[id]);
+    buffers[id].gl_id = 0;
+
+    if (index_buffers[id].gl_id) {
+        tfx_buffer_free(&index_buffers[id]);
+        index_buffers[id].gl_id = 0;
+    }
+
+    buffer_lengths[id] = 0;
+    buffer_triangles[id] = 0;
+    buffer_skinned[id] = false;
+    buffer_bones[id] = 0;
 }
 
 static tfx_program shader(const char *raw, u32 size, const char *attribs[]) {
@@ -264,12 +704,16 @@ int ren_init(SDL_Window *_window) {
     Color transparent = {0, 0, 0, 0};
     texture_none = tfx_texture_new(1, 1, 1, &transparent, TFX_FORMAT_RGBA8, 0);
 
+    texture_s3tc = tfx_get_caps().texture_s3tc;
+
     ren_tex_bind(0, 0);
 
     const char *attribs[] = {
         "vx_position",
         "vx_uv",
         "vx_color",
+        "vx_bone",
+        "vx_weight",
         NULL
     };
 
@@ -283,6 +727,28 @@ int ren_init(SDL_Window *_window) {
 	tfx_vertex_format_add(&vertex_format, 2, 4, false, TFX_TYPE_UBYTE); // Color
 	tfx_vertex_format_end(&vertex_format);
 
+	skinned_format = tfx_vertex_format_start();
+	tfx_vertex_format_add(&skinned_format, 0, 3, false, TFX_TYPE_FLOAT); // Position
+	tfx_vertex_format_add(&skinned_format, 1, 2, false, TFX_TYPE_FLOAT); // UV
+	tfx_vertex_format_add(&skinned_format, 2, 4, false, TFX_TYPE_UBYTE); // Color
+	tfx_vertex_format_add(&skinned_format, 3, 4, false, TFX_TYPE_UBYTE); // Bones
+	tfx_vertex_format_add(&skinned_format, 4, 4, true,  TFX_TYPE_UBYTE); // Weights
+	tfx_vertex_format_end(&skinned_format);
+
+	packed_format = tfx_vertex_format_start();
+	tfx_vertex_format_add(&packed_format, 0, 4, true,  TFX_TYPE_USHORT); // Position
+	tfx_vertex_format_add(&packed_format, 1, 2, true,  TFX_TYPE_USHORT); // UV
+	tfx_vertex_format_add(&packed_format, 2, 4, false, TFX_TYPE_UBYTE);  // Color
+	tfx_vertex_format_end(&packed_format);
+
+	packed_skinned_format = tfx_vertex_format_start();
+	tfx_vertex_format_add(&packed_skinned_format, 0, 4, true,  TFX_TYPE_USHORT); // Position
+	tfx_vertex_format_add(&packed_skinned_format, 1, 2, true,  TFX_TYPE_USHORT); // UV
+	tfx_vertex_format_add(&packed_skinned_format, 2, 4, false, TFX_TYPE_UBYTE);  // Color
+	tfx_vertex_format_add(&packed_skinned_format, 3, 4, false, TFX_TYPE_UBYTE);  // Bones
+	tfx_vertex_format_add(&packed_skinned_format, 4, 4, true,  TFX_TYPE_UBYTE);  // Weights
+	tfx_vertex_format_end(&packed_skinned_format);
+
     proj_uniform     = tfx_uniform_new("projection",      TFX_UNIFORM_MAT4, 1);
     image_uniform    = tfx_uniform_new("image",           TFX_UNIFORM_INT,  1);
     lumos_uniform    = tfx_uniform_new("lumos",           TFX_UNIFORM_INT,  1);
@@ -301,11 +767,21 @@ int ren_init(SDL_Window *_window) {
     lcolor_uniform    = tfx_uniform_new("light_colors",    TFX_UNIFORM_VEC3, 16);
     lamount_uniform   = tfx_uniform_new("light_amount",    TFX_UNIFORM_INT,  1);
 
+    model_view_uniform = tfx_uniform_new("model_view", TFX_UNIFORM_MAT4, INSTANCE_AMOUNT);
+    tint_uniform       = tfx_uniform_new("tint",       TFX_UNIFORM_VEC4, INSTANCE_AMOUNT);
+    uv_rect_uniform    = tfx_uniform_new("uv_rect",    TFX_UNIFORM_VEC4, 1);
+    bones_uniform      = tfx_uniform_new("bones",      TFX_UNIFORM_MAT4, BONE_AMOUNT);
+    skinned_uniform    = tfx_uniform_new("skinned",    TFX_UNIFORM_INT,  1);
+    unpack_uniform     = tfx_uniform_new("unpack",     TFX_UNIFORM_VEC4, 2);
+
     vec_init(&logs);
     vec_init(&calls);
+    vec_init(&instanced_calls);
+    vec_init(&instances);
     vec_init(&transient);
     vec_init(&flat_calls);
     vec_init(&lights);
+    vec_init(&streams);
 
     quad.data = malloc(sizeof(Vertex)*6);
 
@@ -326,17 +802,55 @@ void ren_camera(f32 from[3], f32 to[3], f32 up[3]) {
     mat4_mulvec(camera_target, to, view_matrix);
 }
 
+void ren_frustum(Frustum *out, f32 model[16]) {
+    f32 model_view[16], mvp[16];
+
+    mat4_mul(model_view, model, view_matrix);
+    mat4_mul(mvp, model_view, proj_matrix);
+
+    frustum_from_mat4(out, mvp);
+}
+
 RenderCall *ren_render(RenderCall call) {
     if (!set_up) return NULL;
 
+    capture_textures(&call);
     vec_push(&calls, call);
     return &calls.data[calls.length];
 }
 
 
+void ren_render_instanced(RenderCall call, const Instance *list, u32 amount) {
+    if (!set_up) return;
+    if (!list || !amount) return;
+
+    capture_textures(&call);
+    // nothing on the gpu to draw again and again
+    if (!call.buffer) {
+        for (u32 i = 0; i < amount; i++) {
+            memcpy(call.model, list[i].model, sizeof(call.model));
+            call.tint = list[i].tint;
+
+            vec_push(&calls, call);
+        }
+
+        return;
+    }
+
+    InstancedCall instanced = {
+        .call = call,
+        .first = instances.length,
+        .amount = amount,
+    };
+
+    vec_pusharr(&instances, list, amount);
+    vec_push(&instanced_calls, instanced);
+}
+
 RenderCall *ren_draw(RenderCall call) {
     if (!set_up) return NULL;
 
+    capture_textures(&call);
     vec_push(&flat_calls, call);
     return &flat_calls.data[flat_calls.length];
 }
@@ -353,6 +867,7 @@ void ren_quad(Quad q) {
     RenderCall call = {
         .tint = q.color,
         .texture = q.texture,
+        .image = q.image,
         .mesh = quad,
     };
 
@@ -451,33 +966,712 @@ void ren_mouse_position(i16 *x, i16 *y) {
 }
 
 
-static int compare_triangles_2D(const void *a, const void *b) {
-    const Triangle t_a = *(const Triangle *)a;
-    const Triangle t_b = *(const Triangle *)b;
+typedef struct {
+    u64 key;
+    u32 index;
+} SortKey;
+
+typedef vec_t(SortKey) SortKeyVec;
+
+// flips the bits around so the u32 sorts the same way the float does
+static u32 float_key(f32 f) {
+    u32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// a bigger z gives a smaller key, then the farthest triangles come first
+// like they should.
+static u32 depth_key(const Triangle *t) {
+    f32 z = (t->a.position[2] + t->b.position[2] + t->c.position[2]) / 3.0f;
+
+    return ~float_key(z);
+}
+
+// stable LSD radix sort on the lowest bits of the keys. bytes that are the
+// same for every key (the usual case, UI tends to sit on a few layers) are
+// skipped. returns whichever of the two the result ended up in.
+static SortKey *radix_sort(SortKey *keys, SortKey *swap, u32 amount, u32 bits) {
+    SortKey *from = keys, *to = swap;
+
+    if (amount < 2)
+        return from;
+
+    for (u32 shift = 0; shift < bits; shift += 8) {
+        u32 offsets[256] = { 0 };
+
+        for (u32 i = 0; i < amount; i++)
+            offsets[(from[i].key >> shift) & 0xFF]++;
+
+        if (offsets[(from[0].key >> shift) & 0xFF] == amount)
+            continue;
+
+        u32 total = 0;
+        for (u32 d = 0; d < 256; d++) {
+            u32 count = offsets[d];
+            offsets[d] = total;
+            total += count;
+        }
+
+        for (u32 i = 0; i < amount; i++)
+            to[offsets[(from[i].key >> shift) & 0xFF]++] = from[i];
+
+        SortKey *tmp = from;
+        from = to;
+        to = tmp;
+    }
+
+    return from;
+}
+
+// triangles only get moved once at the end, the image of every triangle
+// gets moved along with it.
+static void sort_triangles_2D(VertexVec *vertices, TextureVec *images) {
+    static SortKeyVec keys, swap;
+    static VertexVec sorted;
+    static TextureVec sorted_images;
+
+    if (!keys.data) {
+        vec_init(&keys);
+        vec_init(&swap);
+        vec_init(&sorted);
+        vec_init(&sorted_images);
+    }
+
+    const u32 amount = vertices->length / 3;
+    if (amount < 2)
+        return;
+
+    Triangle *triangles = (Triangle *)vertices->data;
+
+    vec_clear(&keys);
+    vec_reserve(&keys, amount);
+    vec_reserve(&swap, amount);
+
+    for (u32 i = 0; i < amount; i++)
+        keys.data[i] = (SortKey) { depth_key(&triangles[i]), i };
 
-    f32 avg_z_a = (
-            t_a.a.position[2] +
-            t_a.b.position[2] +
-            t_a.c.position[2]
-        ) / 3.0f;
+    SortKey *order = radix_sort(keys.data, swap.data, amount, 32);
 
-    f32 avg_z_b = (
-            t_b.a.position[2] +
-            t_b.b.position[2] +
-            t_b.c.position[2]
-        ) / 3.0f;
+    vec_clear(&sorted);
+    vec_reserve(&sorted, vertices->length);
+
+    vec_clear(&sorted_images);
+    vec_reserve(&sorted_images, amount);
+
+    Triangle *out = (Triangle *)sorted.data;
+    for (u32 i = 0; i < amount; i++) {
+        out[i] = triangles[order[i].index];
+        sorted_images.data[i] = images->data[order[i].index];
+    }
+
+    sorted.length = vertices->length;
+    sorted_images.length = amount;
+
+    VertexVec tmp = *vertices;
+    *vertices = sorted;
+    sorted = tmp;
+
+    TextureVec tmp_images = *images;
+    *images = sorted_images;
+    sorted_images = tmp_images;
+}
+
+
+// Transient allocations are capped at 65535 vertices each, and the whole
+// transient pool at TFX_TRANSIENT_BUFFER_SIZE. So passes get split into
+// chunks, and whatever doesn't fit the pool spills into a buffer of our own
+// that grows as needed. Each pass gets its own, so growing one never pulls
+// the rug out from under draws that were already submitted this frame.
+#define CHUNK_VERTICES 65535 // multiple of 3
+#define OUTPUT_VERTICES 6    // kept free for the output pass
+
+typedef struct {
+    tfx_buffer buffer;
+    u32 capacity;
+} Spill;
+
+static Spill spills[2];
+static u32 chunks, spilled;
+
+// a run of vertices that all use the same textures
+typedef struct {
+    u32 first, length;
+    Texture image, lumos;
+} Group;
+
+typedef vec_t(Group) GroupVec;
+
+static void setup_main_pass(Group *group) {
+    tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+    tfx_set_texture(&image_uniform, texture_of(group->image), 0);
+    tfx_set_texture(&lumos_uniform, texture_of(group->lumos), 1);
+}
+
+static void setup_quad_pass(Group *group) {
+    tfx_set_state(TFX_STATE_RGB_WRITE);
+    tfx_set_texture(&image_uniform, texture_of(group->image), 0);
+}
+
+// vertices must stay untouched until tfx_frame(). every group is at least
+// one submit, more if it crosses a chunk or the spill.
+static void submit_vertices(
+    u8 view, tfx_program program, Spill *spill, VertexVec *vertices,
+    Group *groups, u32 group_amount, void (*setup)(Group *group)
+) {
+    u32 length = vertices->length - vertices->length % 3;
+
+    u32 available = tfx_transient_buffer_get_available(&vertex_format);
+    available = available > OUTPUT_VERTICES ? available - OUTPUT_VERTICES : 0;
+    available -= available % 3;
+
+    u32 fits = min(length, available);
+    u32 rest = length - fits;
+
+    // one upload for all of the spill, a buffer only gets one per frame
+    if (rest) {
+        if (rest > spill->capacity) {
+            if (spill->buffer.gl_id)
+                tfx_buffer_free(&spill->buffer);
+
+            spill->capacity = max(rest, spill->capacity * 2);
+            spill->buffer = tfx_buffer_new(
+                NULL, spill->capacity * sizeof(Vertex),
+                &vertex_format, TFX_BUFFER_MUTABLE
+            );
+        }
+
+        tfx_buffer_update(&spill->buffer, &vertices->data[fits], 0, rest * sizeof(Vertex));
+        spilled += rest;
+    }
+
+    for (u32 g = 0; g < group_amount; g++) {
+        Group *group = &groups[g];
+
+        u32 first = group->first;
+        u32 end = min(group->first + group->length, length);
+
+        for (u32 amount; first < min(end, fits); first += amount) {
+            amount = min(min(end, fits) - first, CHUNK_VERTICES);
+
+            tfx_transient_buffer buffer = tfx_transient_buffer_new(&vertex_format, amount);
+            memcpy(buffer.data, &vertices->data[first], amount * sizeof(Vertex));
+
+            setup(group);
+            tfx_set_transient_buffer(buffer);
+            tfx_submit(view, program, false);
+
+            chunks++;
+        }
+
+        first = max(first, fits);
+
+        if (first < end) {
+            setup(group);
+            tfx_set_vertices_range(&spill->buffer, end - first, (first - fits) * sizeof(Vertex));
+            tfx_submit(view, program, false);
+
+            chunks++;
+        }
+    }
+}
+
+
+// Main pass calls get cut into slices of up to SLICE_TRIANGLES triangles,
+// which the workers transform and cull into their own spot of the output.
+#define SLICE_TRIANGLES 1024
+
+typedef struct {
+    f32 model_view[16];
+    f32 uv_rect[4]; // scale, offset
+    Color tint;
+    Vertex *data;
+    const u32 *indices; // can be NULL
+
+    // set when the cpu has to do the skinning
+    const VertexAnim *animation;
+    const f32 *palette;
+    u32 bone_amount;
+} Prepared;
+
+typedef struct {
+    u32 prepared;
+    u32 first, length; // in triangles
+    u32 output;        // first vertex in the output
+    u32 kept;          // triangles that survived culling
+} Slice;
+
+typedef vec_t(Prepared) PreparedVec;
+typedef vec_t(Slice) SliceVec;
+
+typedef struct {
+    Prepared *prepared;
+    Slice *slices;
+    Vertex *output;
+    Frustum frustum;
+} SliceWork;
+
+#define _CCM(a,b) (u8) (((unsigned)a * (unsigned)b + 255u) >> 8)
+
+static void transform_vertex(Prepared *p, const Vertex *vertex, Vertex *copy) {
+    copy->uv[0] = p->uv_rect[0] * vertex->uv[0] + p->uv_rect[2];
+    copy->uv[1] = p->uv_rect[1] * vertex->uv[1] + p->uv_rect[3];
+
+    u8 fr = _CCM(p->tint.r, vertex->color.r);
+    u8 fg = _CCM(p->tint.g, vertex->color.g);
+    u8 fb = _CCM(p->tint.b, vertex->color.b);
+    u8 fa = _CCM(p->tint.a, vertex->color.a);
+
+    copy->color = (Color) { fr, fg, fb, fa };
+
+    // vertex and copy can be the same
+    f32 position[3];
+    mat4_mulvec(position, (f32 *)vertex->position, p->model_view);
+    memcpy(copy->position, position, sizeof(position));
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+// Four vertices at a time: positions and UVs get transposed into x/y/z/u
+// lanes, colors are tinted as packed words in 16 bit lanes.
+static void transform_vertices(Prepared *p, const Vertex *in, Vertex *out, u32 amount) {
+    const f32 *m = p->model_view;
+
+    const __m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]), m8  = _mm_set1_ps(m[8]),  m12 = _mm_set1_ps(m[12]);
+    const __m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]), m9  = _mm_set1_ps(m[9]),  m13 = _mm_set1_ps(m[13]);
+    const __m128 m2 = _mm_set1_ps(m[2]), m6 = _mm_set1_ps(m[6]), m10 = _mm_set1_ps(m[10]), m14 = _mm_set1_ps(m[14]);
+
+    const __m128 su = _mm_set1_ps(p->uv_rect[0]), sv = _mm_set1_ps(p->uv_rect[1]);
+    const __m128 ou = _mm_set1_ps(p->uv_rect[2]), ov = _mm_set1_ps(p->uv_rect[3]);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(255);
+    const __m128i tint = _mm_unpacklo_epi8(_mm_set1_epi32(p->tint.full), zero);
+
+    u32 i = 0;
+    for (; i + 4 <= amount; i += 4) {
+        const Vertex *v = &in[i];
+
+        // x, y, z, u
+        __m128 x = _mm_loadu_ps(v[0].position);
+        __m128 y = _mm_loadu_ps(v[1].position);
+        __m128 z = _mm_loadu_ps(v[2].position);
+        __m128 u = _mm_loadu_ps(v[3].position);
+        _MM_TRANSPOSE4_PS(x, y, z, u);
+
+        __m128 t = _mm_set_ps(v[3].uv[1], v[2].uv[1], v[1].uv[1], v[0].uv[1]);
+
+        __m128 px = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, m0), _mm_mul_ps(y, m4)),
+            _mm_add_ps(_mm_mul_ps(z, m8), m12)
+        );
+
+        __m128 py = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, m1), _mm_mul_ps(y, m5)),
+            _mm_add_ps(_mm_mul_ps(z, m9), m13)
+        );
+
+        __m128 pz = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, m2), _mm_mul_ps(y, m6)),
+            _mm_add_ps(_mm_mul_ps(z, m10), m14)
+        );
+
+        __m128 pu = _mm_add_ps(_mm_mul_ps(u, su), ou);
+        __m128 pv = _mm_add_ps(_mm_mul_ps(t, sv), ov);
+
+        _MM_TRANSPOSE4_PS(px, py, pz, pu);
+
+        // same as _CCM, and then flipped to r, g, b, a
+        __m128i colors = _mm_set_epi32(v[3].color.full, v[2].color.full, v[1].color.full, v[0].color.full);
+
+        __m128i lo = _mm_unpacklo_epi8(colors, zero);
+        __m128i hi = _mm_unpackhi_epi8(colors, zero);
+
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, tint), round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, tint), round), 8);
+
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+
+        colors = _mm_packus_epi16(lo, hi);
+
+        f32 vs[4];
+        u32 cs[4];
+        _mm_storeu_ps(vs, pv);
+        _mm_storeu_si128((__m128i *)cs, colors);
+
+        // position and uv[0] sit next to each other
+        _mm_storeu_ps(out[i+0].position, px);
+        _mm_storeu_ps(out[i+1].position, py);
+        _mm_storeu_ps(out[i+2].position, pz);
+        _mm_storeu_ps(out[i+3].position, pu);
+
+        for (int k = 0; k < 4; k++) {
+            out[i+k].uv[1] = vs[k];
+            out[i+k].color.full = cs[k];
+        }
+    }
+
+    for (; i < amount; i++)
+        transform_vertex(p, &in[i], &out[i]);
+}
+#else
+
+static void transform_vertices(Prepared *p, const Vertex *in, Vertex *out, u32 amount) {
+    for (u32 i = 0; i < amount; i++)
+        transform_vertex(p, &in[i], &out[i]);
+}
+#endif
+
+// the box goes through model_view corner by corner, so whatever comes
+// out is a view space box around the rotated one.
+static bool box_visible(Box box, const f32 model_view[16], Frustum *frustum) {
+    static const Box empty = { 0 };
+
+    if (!memcmp(&box, &empty, sizeof(Box)))
+        return true;
+
+    f32 _min[3], _max[3];
+
+    for (int c = 0; c < 8; c++) {
+        f32 corner[3] = {
+            (c & 1) ? box.max[0] : box.min[0],
+            (c & 2) ? box.max[1] : box.min[1],
+            (c & 4) ? box.max[2] : box.min[2],
+        }, out[3];
+
+        mat4_mulvec(out, corner, (f32 *)model_view);
+
+        for (int i = 0; i < 3; i++) {
+            _min[i] = c ? min(_min[i], out[i]) : out[i];
+            _max[i] = c ? max(_max[i], out[i]) : out[i];
+        }
+    }
+
+    return frustum_vs_aabb(*frustum, _min, _max);
+}
+
+static void color_to_vec4(f32 out[4], Color color) {
+    out[0] = color.r / 255.0f;
+    out[1] = color.g / 255.0f;
+    out[2] = color.b / 255.0f;
+    out[3] = color.a / 255.0f;
+}
+
+static void call_uv_rect(f32 out[4], RenderCall call) {
+    f32 w, h;
+    texture_size(call.image, &w, &h);
+
+    out[0] = (f32)call.texture.w / w;
+    out[1] = (f32)call.texture.h / h;
+    out[2] = (f32)call.texture.x / w;
+    out[3] = (f32)call.texture.y / h;
+}
+
+// a zero sized slice means all of the image
+static void fill_texture_slice(RenderCall *call) {
+    f32 w, h;
+    texture_size(call->image, &w, &h);
+
+    if (call->texture.w == 0)
+        call->texture.w = w;
+
+    if (call->texture.h == 0)
+        call->texture.h = h;
+}
+
+// the triangles of a retained buffer a call wants, false if there are none
+static bool buffer_range(RenderCall call, Range *range) {
+    if (!buffers[call.buffer-1].gl_id)
+        return false;
+
+    u32 length = buffer_lengths[call.buffer-1];
+
+    *range = call.range;
+    if (!range->length)
+        *range = (Range) { 0, buffer_triangles[call.buffer-1] };
+
+    return ((u64)range->offset + range->length) * 3 <= length;
+}
+
+// the triangles of a call drawn from its mesh, false if they're past it
+static bool mesh_range(RenderCall *call) {
+    u32 triangles = msh_triangles(call->mesh);
+
+    if (!call->range.length)
+        call->range = (Range) { 0, triangles };
+
+    // the lods come after the mesh's own indices
+    if (call->mesh.indices)
+        triangles += call->mesh.lod_index_amount / 3;
+
+    return (u64)call->range.offset + call->range.length <= triangles;
+}
+
+#define LOD_PIXELS 1.0f // how far off a lod may look, in (snapped) pixels
+
+// the simplest lod that's still less than LOD_PIXELS off where the box
+// ends up. in the fog it may be off more, it fades the difference away.
+static u32 lod_level(const Lods *lods, Box box, const f32 model_view[16]) {
+    f32 center[3], view[3], extent = 0.0f, scale = 0.0f;
+
+    for (int c = 0; c < 3; c++) {
+        center[c] = (box.min[c] + box.max[c]) * 0.5f;
+        extent += (box.max[c] - box.min[c]) * (box.max[c] - box.min[c]);
+
+        // the model matrix's biggest scale
+        scale = max(scale, vec_dot((f32 *)&model_view[c*4], (f32 *)&model_view[c*4], 3));
+    }
+
+    scale = sqrtf(scale);
+    mat4_mulvec(view, center, (f32 *)model_view);
+
+    // as close as any of the box can get
+    f32 distance = -view[2] - sqrtf(extent) * 0.5f * scale;
+
+    if (distance <= 0.0f)
+        return 0;
+
+    f32 pixels = proj_matrix[5] * resolution[1] / (2.0f * (1 + snapping)) * scale / distance;
+    f32 fog = clamp(1.0f - distance / far, 0.0f, 1.0f);
+    f32 allowed = LOD_PIXELS / max(fog, 0.01f);
+
+    for (u32 l = min(lods->amount, LOD_AMOUNT); l-- > 1;) {
+        if (lods->errors[l] * pixels <= allowed)
+            return l;
+    }
 
-    if (avg_z_a < avg_z_b) return 1;
-    if (avg_z_a > avg_z_b) return -1;
     return 0;
 }
 
+// a lod's range for a buffer, if there is one and it fits
+static Range lod_range(RenderCall call, Range range, u32 level) {
+    if (!call.lods || level >= call.lods->amount)
+        return range;
+
+    Range lod;
+    call.range = call.lods->ranges[level];
+
+    return buffer_range(call, &lod) ? lod : range;
+}
+
+// lods index the whole mesh they were made for, a call drawing less of it
+// (a mod_submesh slice) can't use them and draws as it is
+static bool lods_fit(RenderCall call) {
+    for (u32 l = 0; l < min(call.lods->amount, LOD_AMOUNT); l++) {
+        Range range;
+        call.range = call.lods->ranges[l];
+
+        if (call.buffer ? !buffer_range(call, &range) : !mesh_range(&call))
+            return false;
+    }
+
+    return true;
+}
+
+// the pose a call can be skinned with in the vertex shader, if any
+static const AnimationState *gpu_skin(RenderCall call) {
+    const AnimationState *animation = call.animation;
+
+    if (!animation || !animation->palette || compat_mode)
+        return NULL;
+
+    if (!call.buffer || !buffer_skinned[call.buffer-1])
+        return NULL;
+
+    // a pose without every bone the vertices use goes the cpu way, that
+    // one skips the missing ones
+    if (animation->bone_amount > BONE_AMOUNT || animation->bone_amount < buffer_bones[call.buffer-1])
+        return NULL;
+
+    return animation;
+}
+
+// the vertex shader does the work ren_frame would do for transient calls
+static void draw_instances(
+    u8 view, RenderCall *call, Range range,
+    f32 model_views[][16], f32 tints[][4], u32 amount,
+    const AnimationState *skin
+) {
+    const Unpack *unpack = &buffer_unpack[call->buffer-1];
+
+    // packed uvs are in the mesh's uv range, that goes in before the slice
+    f32 uv_rect[4];
+    call_uv_rect(uv_rect, *call);
+
+    uv_rect[2] += unpack->uv[2] * uv_rect[0];
+    uv_rect[3] += unpack->uv[3] * uv_rect[1];
+    uv_rect[0] *= unpack->uv[0];
+    uv_rect[1] *= unpack->uv[1];
+
+    int skinned = skin != NULL;
+    if (skinned)
+        tfx_set_uniform(&bones_uniform, skin->palette, skin->bone_amount);
+
+    tfx_set_uniform_int(&skinned_uniform, &skinned, 1);
+    tfx_set_uniform(&model_view_uniform, model_views[0], amount);
+    tfx_set_uniform(&tint_uniform, tints[0], amount);
+    tfx_set_uniform(&uv_rect_uniform, uv_rect, 1);
+    tfx_set_uniform(&unpack_uniform, unpack->position[0], 2);
+
+    tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
+
+    tfx_buffer *vertices = &buffers[call->buffer-1];
+    tfx_buffer *indices = &index_buffers[call->buffer-1];
+
+    if (indices->gl_id) {
+        u32 size = indices->flags & TFX_BUFFER_INDEX_32 ? sizeof(u32) : sizeof(u16);
+
+        tfx_set_vertices(vertices, range.length*3);
+        tfx_set_indices(indices, range.length*3, range.offset*3*size);
+    } else {
+        tfx_set_vertices_range(vertices, range.length*3, range.offset*3*vertices->format.stride);
+    }
+
+    tfx_set_instances(amount);
+    tfx_set_texture(&image_uniform, texture_of(call->image), 0);
+    tfx_set_texture(&lumos_uniform, texture_of(call->lumos), 1);
+    tfx_submit(view, program, false);
+}
+
+// a main pass call that made it past culling, waiting to be sorted
+typedef struct {
+    RenderCall call;
+    f32 model_view[16];
+    const AnimationState *skin; // on the gpu
+    bool cpu_skin;
+} Queued;
+
+typedef vec_t(Queued) QueuedVec;
+
+static bool queued_transient(const Queued *q) {
+    // buffers can't be skinned on the cpu, so those go the slow way
+    return !q->call.buffer || q->cpu_skin;
+}
+
+// retained calls first, then by textures and buffer so the same state ends
+// up next to each other, front to back inside of that so the depth test
+// gets to throw away as much as it can.
+//
+//  63     | 62 - 55 | 54 - 47 | 46 - 31 | 30 - 0
+//  kind   | image   | lumos   | buffer  | depth
+static u64 queued_key(const Queued *q) {
+    bool transient = queued_transient(q);
+    f32 distance = -q->model_view[14];
+
+    return (u64)transient << 63
+         | (u64)q->call.image << 55
+         | (u64)q->call.lumos << 47
+         | (u64)(transient ? 0 : q->call.buffer) << 31
+         | float_key(distance) >> 1;
+}
+
+// whether b can be another instance in the draw of a
+static bool same_draw(const Queued *a, const Queued *b) {
+    if (a->skin || b->skin || queued_transient(b))
+        return false;
+
+    return a->call.buffer == b->call.buffer
+        && a->call.image == b->call.image
+        && a->call.lumos == b->call.lumos
+        && a->call.range.offset == b->call.range.offset
+        && a->call.range.length == b->call.range.length
+        && !memcmp(&a->call.texture, &b->call.texture, sizeof(TextureSlice));
+}
+
+// returns the amount of triangles written to out
+static u32 transform_triangles(Prepared *p, Vertex *in, Vertex *out, u32 amount, Frustum *frustum) {
+    transform_vertices(p, in, out, amount*3);
+
+    u32 kept = 0;
+
+    for (u32 a = 0; a < amount; a++) {
+        Vertex *tri = &out[a*3];
+
+        // view space
+        if (!frustum_vs_triangle(*frustum, tri[0].position, tri[1].position, tri[2].position))
+            continue;
+
+        if (kept != a)
+            memcpy(&out[kept*3], tri, sizeof(Triangle));
+
+        kept++;
+    }
+
+    return kept;
+}
+
+// linear blend skinning, for when the vertex shader can't
+static void skin_vertices(Prepared *p, u32 first, Vertex *out, u32 amount) {
+    for (u32 i = 0; i < amount; i++) {
+        u32 k = p->indices ? p->indices[first + i] : first + i;
+
+        const Vertex *vertex = &p->data[k];
+        const VertexAnim *animation = &p->animation[k];
+
+        f32 position[3] = { 0.0, 0.0, 0.0 };
+        f32 total = 0.0;
+
+        for (int k = 0; k < 4; k++) {
+            if (!animation->weight[k] || animation->bone[k] >= p->bone_amount)
+                continue;
+
+            f32 moved[3];
+            mat4_mulvec(moved, (f32 *)vertex->position, (f32 *)&p->palette[animation->bone[k]*16]);
+
+            for (int c = 0; c < 3; c++)
+                position[c] += moved[c] * animation->weight[k];
+
+            total += animation->weight[k];
+        }
+
+        out[i] = *vertex;
+
+        if (total > 0.0)
+            vec_scale(out[i].position, position, 1.0f / total, 3);
+    }
+}
+
+// indexed meshes get their triangles spelled out, the rest works on those
+static void gather_vertices(const Vertex *data, const u32 *indices, Vertex *out, u32 amount) {
+    for (u32 i = 0; i < amount; i++)
+        out[i] = data[indices[i]];
+}
+
+static void slice_job(void *userdata, u32 index) {
+    SliceWork *work = userdata;
+    Slice *slice = &work->slices[index];
+    Prepared *p = &work->prepared[slice->prepared];
+
+    Vertex *in = &p->data[slice->first*3];
+    Vertex *out = &work->output[slice->output];
+
+    if (p->palette) {
+        skin_vertices(p, slice->first*3, out, slice->length*3);
+        in = out;
+    } else if (p->indices) {
+        gather_vertices(p->data, &p->indices[slice->first*3], out, slice->length*3);
+        in = out;
+    }
+
+    slice->kept = transform_triangles(p, in, out, slice->length, &work->frustum);
+}
+
 
 int ren_frame() {
     static tfx_canvas canvas;
     static Frustum frustum;
 
     static VertexVec tmp_vertices;
+    static VertexVec flat_vertices;
+    static TextureVec flat_images;
+    static PreparedVec prepared_calls;
+    static SliceVec slices;
+    static QueuedVec queued;
+    static SortKeyVec queue_keys, queue_swap;
+    static GroupVec groups, flat_groups;
 
     int curr_width, curr_height;
     SDL_GL_GetDrawableSize(window, &curr_width, &curr_height);
@@ -537,19 +1731,40 @@ int ren_frame() {
 
         if (!tmp_vertices.data)
             vec_init(&tmp_vertices);
+
+        if (!flat_vertices.data)
+            vec_init(&flat_vertices);
+
+        if (!flat_images.data)
+            vec_init(&flat_images);
+
+        if (!queued.data) {
+            vec_init(&queued);
+            vec_init(&queue_keys);
+            vec_init(&queue_swap);
+        }
+
+        if (!groups.data) {
+            vec_init(&groups);
+            vec_init(&flat_groups);
+        }
+
+        if (!prepared_calls.data)
+            vec_init(&prepared_calls);
+
+        if (!slices.data)
+            vec_init(&slices);
     }
 
     #define CALLCHECK() {                         \
         if (call.disable) continue;               \
         if (call.tint.a == 0) continue;           \
                                                   \
-        if (call.texture.w == 0)                  \
-            call.texture.w = texture_main.width;  \
-                                                  \
-        if (call.texture.h == 0)                  \
-            call.texture.h = texture_main.height; \
+        fill_texture_slice(&call);                \
     }
 
+    stream_textures();
+
     const f32 aspect = resolution[0] / resolution[1];
 
     mat4_projection(proj_matrix, 80, aspect, 0.001f, far+6.0, false);
@@ -610,8 +1825,6 @@ int ren_frame() {
     tfx_set_uniform_int(&lamount_uniform, &real_index, -1);
     //tfx_set_uniform_int(&dither_uniform, (int *)&dithering, -1);
 
-    tfx_set_state(TFX_STATE_RGB_WRITE | TFX_STATE_DEPTH_WRITE);
-
     // RENDER TRIANGLES
     const u8 view = 1;
     tfx_view_set_clear_depth(view, 1.0);
@@ -619,10 +1832,25 @@ int ren_frame() {
     tfx_view_set_clear_color(view, clear_color.full);
 	tfx_view_set_name(view, "the main pass");
     tfx_view_set_canvas(view, &canvas, 0);
+    tfx_touch(view); // clear even when nothing ends up in here
 
     vec_clear(&tmp_vertices);
+    vec_clear(&prepared_calls);
+    vec_clear(&slices);
+
+    u32 slice_vertices = 0;
+
+    static const f32 identity[16] = IDENTITY_MATRIX;
+    static const f32 no_tint[4] = { 1.0, 1.0, 1.0, 1.0 };
+    static const f32 no_uv_rect[4] = { 1.0, 1.0, 0.0, 0.0 };
+
+    u32 retained = 0, culled = 0, draws = 0, simpler = 0;
+
+    vec_clear(&queued);
+    vec_clear(&queue_keys);
+    vec_clear(&groups);
 
-    for (u32 i = 0; i < calls.length; i++) {
+    for (int i = 0; i < calls.length; i++) {
         RenderCall call = calls.data[i];
 
         CALLCHECK()
@@ -630,52 +1858,249 @@ int ren_frame() {
         // model * view
         mat4_mul(m, call.model, view_matrix);
 
-        if (!call.range.length)
-            call.range = (Range) {
-                .offset = 0,
-                .length = call.mesh.length/3
+        // posed meshes can leave their bind pose box
+        if (!call.animation && !box_visible(call.mesh.box, m, &frustum)) {
+            culled++;
+            continue;
+        }
+
+        if (call.lods && !lods_fit(call))
+            call.lods = NULL;
+
+        if (call.lods && call.lods->amount) {
+            u32 level = lod_level(call.lods, call.mesh.box, m);
+
+            call.range = call.lods->ranges[level];
+            simpler += level > 0;
+        }
+
+        Queued entry = {
+            .call = call,
+            .skin = gpu_skin(call),
+        };
+
+        entry.cpu_skin = !entry.skin && call.animation && call.animation->palette
+                      && call.mesh.data && call.mesh.animation;
+
+        memcpy(entry.model_view, m, sizeof(m));
+
+        vec_push(&queue_keys, ((SortKey) { queued_key(&entry), queued.length }));
+        vec_push(&queued, entry);
+    }
+
+    vec_reserve(&queue_swap, queue_keys.length);
+    SortKey *order = radix_sort(queue_keys.data, queue_swap.data, queue_keys.length, 64);
+
+    // gles2 has no gl_InstanceID, so there it's one draw each
+    const u32 per_draw = compat_mode ? 1 : INSTANCE_AMOUNT;
+
+    static f32 model_views[INSTANCE_AMOUNT][16];
+    static f32 tints[INSTANCE_AMOUNT][4];
+
+    for (int i = 0; i < queued.length;) {
+        Queued *entry = &queued.data[order[i].index];
+        RenderCall call = entry->call;
+
+        if (!queued_transient(entry)) {
+            Range range;
+            if (!buffer_range(call, &range)) {
+                i++;
+                continue;
+            }
+
+            // the same mesh looking the same way becomes one instanced draw
+            u32 amount = 0;
+            do {
+                Queued *same = &queued.data[order[i].index];
+
+                memcpy(model_views[amount], same->model_view, sizeof(m));
+                color_to_vec4(tints[amount], same->call.tint);
+
+                amount++;
+                i++;
+            } while (
+                i < queued.length && amount < per_draw &&
+                same_draw(entry, &queued.data[order[i].index])
+            );
+
+            draw_instances(view, &call, range, model_views, tints, amount, entry->skin);
+
+            retained += range.length * amount;
+            draws++;
+            continue;
+        }
+
+        i++;
+
+        if (!mesh_range(&call))
+            continue;
+
+        // the keys put calls with the same textures next to each other
+        if (!groups.length
+            || vec_last(&groups).image != call.image
+            || vec_last(&groups).lumos != call.lumos
+        ) {
+            Group group = {
+                .first = slices.length,
+                .image = call.image,
+                .lumos = call.lumos,
+            };
+
+            vec_push(&groups, group);
+        }
+
+        Prepared prepared = {
+            .tint = call.tint,
+            .data = call.mesh.data,
+            .indices = call.mesh.indices,
+        };
+
+        call_uv_rect(prepared.uv_rect, call);
+
+        if (entry->cpu_skin) {
+            prepared.animation = call.mesh.animation;
+            prepared.palette = call.animation->palette;
+            prepared.bone_amount = call.animation->bone_amount;
+        }
+
+        memcpy(prepared.model_view, entry->model_view, sizeof(m));
+        vec_push(&prepared_calls, prepared);
+
+        for (u32 a = 0; a < call.range.length; a += SLICE_TRIANGLES) {
+            Slice slice = {
+                .prepared = prepared_calls.length - 1,
+                .first = call.range.offset + a,
+                .length = min(call.range.length - a, SLICE_TRIANGLES),
+                .output = slice_vertices,
             };
 
-        for (u32 a = call.range.offset; a < call.range.offset+call.range.length; a++) {
-            Triangle tri;
+            vec_push(&slices, slice);
+            slice_vertices += slice.length*3;
+            vec_last(&groups).length++;
+        }
+    }
+
+    u32 instanced = 0, instanced_draws = 0;
+
+    for (int i = 0; i < instanced_calls.length; i++) {
+        InstancedCall batch = instanced_calls.data[i];
+        RenderCall call = batch.call;
 
-            for (u32 b = 0; b < 3; b++) {
-                Vertex vertex = call.mesh.data[(a*3)+b];
-                Vertex *copy = &tri.arr[b];
+        if (call.disable)
+            continue;
 
-                #define _CCM(a,b) (u8) (((unsigned)a * (unsigned)b + 255u) >> 8)
-                #define _CKW(a) ((f32)(a) / (f32)texture_main.width)
-                #define _CKH(a) ((f32)(a) / (f32)texture_main.height)
+        fill_texture_slice(&call);
 
-                copy->uv[0] = _CKW(call.texture.w) * vertex.uv[0] + _CKW(call.texture.x);
-                copy->uv[1] = _CKH(call.texture.h) * vertex.uv[1] + _CKH(call.texture.y);
+        Range range;
+        if (!buffer_range(call, &range))
+            continue;
 
-                u8 fr = _CCM(call.tint.r, vertex.color.r);
-                u8 fg = _CCM(call.tint.g, vertex.color.g);
-                u8 fb = _CCM(call.tint.b, vertex.color.b);
-                u8 fa = _CCM(call.tint.a, vertex.color.a);
+        if (call.lods && !lods_fit(call))
+            call.lods = NULL;
 
-                copy->color = (Color) { fr, fg, fb, fa };
+        // every instance gets the same pose
+        const AnimationState *skin = gpu_skin(call);
 
-                // projection space
-                mat4_mulvec(copy->position, vertex.position, m);
+        // every draw goes as simple as its closest instance allows
+        u32 amount = 0, level = LOD_AMOUNT;
+
+        for (u32 k = 0; k < batch.amount; k++) {
+            Instance instance = instances.data[batch.first + k];
+
+            if (instance.tint.a == 0)
+                continue;
+
+            mat4_mul(model_views[amount], instance.model, view_matrix);
+
+            if (!box_visible(call.mesh.box, model_views[amount], &frustum)) {
+                culled++;
+                continue;
             }
 
-            // view space
-            if (frustum_vs_triangle(frustum, tri.a.position, tri.b.position, tri.c.position))
-                vec_pusharr(&tmp_vertices, tri.arr, 3);
+            color_to_vec4(tints[amount], instance.tint);
+
+            if (call.lods)
+                level = min(level, lod_level(call.lods, call.mesh.box, model_views[amount]));
+
+            if (++amount < per_draw)
+                continue;
+
+            draw_instances(view, &call, lod_range(call, range, level), model_views, tints, amount, skin);
+            instanced += amount;
+            instanced_draws++;
+            simpler += level > 0 && level < LOD_AMOUNT;
+            amount = 0;
+            level = LOD_AMOUNT;
+        }
+
+        if (amount) {
+            draw_instances(view, &call, lod_range(call, range, level), model_views, tints, amount, skin);
+            instanced += amount;
+            instanced_draws++;
+            simpler += level > 0 && level < LOD_AMOUNT;
         }
     }
+
+    vec_clear(&instanced_calls);
+    vec_clear(&instances);
+
+    // transform and cull everything on the workers, then squash the
+    // surviving triangles of every slice together.
+    vec_reserve(&tmp_vertices, slice_vertices);
+
+    SliceWork work = {
+        .prepared = prepared_calls.data,
+        .slices = slices.data,
+        .output = tmp_vertices.data,
+        .frustum = frustum,
+    };
+
+    job_parallel(slice_job, &work, slices.length);
+
+    u32 kept = 0;
+    for (int i = 0; i < slices.length; i++) {
+        Slice *slice = &slices.data[i];
+
+        if (slice->output != kept)
+            memmove(
+                &tmp_vertices.data[kept],
+                &tmp_vertices.data[slice->output],
+                slice->kept * sizeof(Triangle)
+            );
+
+        slice->output = kept;
+        kept += slice->kept*3;
+    }
+
+    tmp_vertices.length = kept;
+
+    // groups were counted in slices so far, now they know their vertices
+    for (int i = 0; i < groups.length; i++) {
+        Group *group = &groups.data[i];
+
+        if (!group->length) {
+            group->first = 0;
+            continue;
+        }
+
+        Slice *first = &slices.data[group->first];
+        Slice *last = &slices.data[group->first + group->length - 1];
+
+        group->first = first->output;
+        group->length = last->output + last->kept*3 - first->output;
+    }
+
     vec_clear(&calls);
 
-    Triangle *t_list = (Triangle *)tmp_vertices.data;
     u32 t_amount = tmp_vertices.length/3;
 
-    tfx_transient_buffer buffer = tfx_transient_buffer_new(&vertex_format, t_amount*3);
-    memcpy(buffer.data, tmp_vertices.data, t_amount*sizeof(Triangle));
-
     ren_log("\n// RENDERER //////");
     ren_log("TRIANGLES:  %i", t_amount);
+    ren_log("RETAINED:   %i", retained);
+    ren_log("INSTANCED:  %i (%i draws)", instanced, instanced_draws);
+    ren_log("BATCHES:    %i draws, %i groups", draws, groups.length);
+    ren_log("CULLED:     %i calls", culled);
+    ren_log("LODS:       %i draws simpler", simpler);
     ren_log("RESOLUTION: %ix%i", width, height);
     ren_log("LIGHTS:     %i", real_index);
 
@@ -685,78 +2110,90 @@ int ren_frame() {
 
     vec_clear(&logs);
 
-    tfx_set_transient_buffer(buffer);
-    tfx_set_texture(&image_uniform, &texture_main, 0);
-    tfx_set_texture(&lumos_uniform, &texture_lumos, 1);
-    tfx_submit(view, program, false);
+    const int not_skinned = 0;
+
+    tfx_set_uniform(&model_view_uniform, identity, 1);
+    tfx_set_uniform(&tint_uniform, no_tint, 1);
+    tfx_set_uniform(&uv_rect_uniform, no_uv_rect, 1);
+    tfx_set_uniform_int(&skinned_uniform, &not_skinned, 1);
+    tfx_set_uniform(&unpack_uniform, no_unpack.position[0], 2);
+
+    chunks = 0;
+    spilled = 0;
+
+    submit_vertices(
+        view, program, &spills[0], &tmp_vertices,
+        groups.data, groups.length, setup_main_pass
+    );
 
 
     // RENDER QUADS
     const u8 ui = 3;
-    tfx_set_state(TFX_STATE_RGB_WRITE);
     tfx_view_set_name(ui, "the quad pass");
     tfx_view_set_depth_test(ui, TFX_DEPTH_TEST_LT);
     tfx_view_set_canvas(ui, &canvas, 0);
-    tfx_set_texture(&image_uniform, &texture_main, 0);
-
-    vec_clear(&tmp_vertices);
 
-    const u16 w = resolution[0] / 2.f;
-    const u16 h = resolution[1] / 2.f;
+    vec_clear(&flat_vertices);
+    vec_clear(&flat_images);
 
-    for (u32 i = 0; i < flat_calls.length; i++) {
+    for (int i = 0; i < flat_calls.length; i++) {
         RenderCall call = flat_calls.data[i];
 
         CALLCHECK()
 
-        if (!call.range.length)
-            call.range = (Range) {
-                .offset = 0,
-                .length = call.mesh.length/3
-            };
+        if (!mesh_range(&call))
+            continue;
 
-        for (u32 t = call.range.offset; t < call.range.offset+call.range.length; t++) {
-            for (u32 j = 0; j < 3; j++) {
-                Vertex vertex = call.mesh.data[(t*3)+j];
+        Prepared prepared = {
+            .tint = call.tint,
+        };
 
-                #define _CCM(a,b) (u8) (((unsigned)a * (unsigned)b + 255u) >> 8)
-                #define _CKW(a) ((f32)(a) / (f32)texture_main.width)
-                #define _CKH(a) ((f32)(a) / (f32)texture_main.height)
+        call_uv_rect(prepared.uv_rect, call);
+        memcpy(prepared.model_view, call.model, sizeof(call.model));
 
-                Vertex copy = {
-                    .uv = {
-                        _CKW(call.texture.w) * vertex.uv[0] + _CKW(call.texture.x),
-                        _CKH(call.texture.h) * vertex.uv[1] + _CKH(call.texture.y)
-                    },
-                };
+        u32 amount = call.range.length*3;
+        vec_reserve(&flat_vertices, flat_vertices.length + amount);
 
-                u8 fr = _CCM(call.tint.r, vertex.color.r);
-                u8 fg = _CCM(call.tint.g, vertex.color.g);
-                u8 fb = _CCM(call.tint.b, vertex.color.b);
-                u8 fa = _CCM(call.tint.a, vertex.color.a);
+        Vertex *in = &call.mesh.data[call.range.offset*3];
+        Vertex *out = &flat_vertices.data[flat_vertices.length];
 
-                copy.color = (Color) { fr, fg, fb, fa };
+        if (call.mesh.indices) {
+            gather_vertices(call.mesh.data, &call.mesh.indices[call.range.offset*3], out, amount);
+            in = out;
+        }
 
-                mat4_mulvec(copy.position, vertex.position, call.model);
+        transform_vertices(&prepared, in, out, amount);
 
-                vec_push(&tmp_vertices, copy);
-            }
-        }
+        flat_vertices.length += amount;
+
+        for (u32 t = 0; t < call.range.length; t++)
+            vec_push(&flat_images, call.image);
     }
 
-    if (tmp_vertices.length % 3 != 0)
+    if (flat_vertices.length % 3 != 0)
         printf("?\n");
 
-    //qsort(tmp_vertices.data, tmp_vertices.ca)
+    sort_triangles_2D(&flat_vertices, &flat_images);
+
+    // depth order wins, runs of the same image still go together
+    vec_clear(&flat_groups);
+    for (int t = 0; t < flat_images.length; t++) {
+        Texture image = flat_images.data[t];
+
+        if (!flat_groups.length || vec_last(&flat_groups).image != image) {
+            Group group = { .first = t*3, .image = image };
+            vec_push(&flat_groups, group);
+        }
 
-    qsort(tmp_vertices.data, tmp_vertices.length / 3, sizeof(Triangle), compare_triangles_2D);
+        vec_last(&flat_groups).length += 3;
+    }
 
-    tfx_transient_buffer quad_buffer = tfx_transient_buffer_new(&vertex_format, tmp_vertices.length);
-    memcpy(quad_buffer.data, tmp_vertices.data, tmp_vertices.length * sizeof(Vertex));
-    t_amount += tmp_vertices.length;
+    t_amount += flat_vertices.length;
 
-    tfx_set_transient_buffer(quad_buffer);
-    tfx_submit(ui, quad_program, false);
+    submit_vertices(
+        ui, quad_program, &spills[1], &flat_vertices,
+        flat_groups.data, flat_groups.length, setup_quad_pass
+    );
 
     const f32 size = (float)(t_amount * sizeof(Triangle)) / 1024.0f;
     ren_log("GPU UPLOADS: (%.3gkb)", size);
@@ -766,6 +2203,9 @@ int ren_frame() {
     const f32 transient_mem = (float)(transient.length * sizeof(Triangle)) / 1024.0f;
     ren_log("TRANSIENT:   (%.3gkb)", transient_mem);
 
+    if (chunks > 2 || spilled)
+        ren_log("CHUNKS:      %i (%i vertices spilled)", chunks, spilled);
+
     vec_clear(&transient);
 
 
@@ -815,10 +2255,34 @@ void ren_byebye() {
 
     vec_deinit(&logs);
     vec_deinit(&calls);
+    vec_deinit(&instanced_calls);
+    vec_deinit(&instances);
     vec_deinit(&transient);
     vec_deinit(&flat_calls);
     vec_deinit(&lights);
 
+    // the workers might still be decoding some
+    for (int i = 0; i < streams.length; i++) {
+        while (!SDL_AtomicGet(&streams.data[i]->decoded))
+            SDL_Delay(1);
+
+        free_stream(streams.data[i]);
+    }
+
+    vec_deinit(&streams);
+
+    for (int i = 0; i < BUFFER_AMOUNT; i++) {
+        if (buffers[i].gl_id)
+            tfx_buffer_free(&buffers[i]);
+
+        if (index_buffers[i].gl_id)
+            tfx_buffer_free(&index_buffers[i]);
+    }
+
+    for (int i = 0; i < 2; i++)
+        if (spills[i].buffer.gl_id)
+            tfx_buffer_free(&spills[i].buffer);
+
     free(quad.data);
 
     tfx_shutdown();
@@ -1,11 +1,34 @@
 #define LIGHT_AMOUNT 32
+#define BONE_AMOUNT 64
+
+// gles2 only promises 128 vertex uniform vectors, the lights take most
+#ifdef COMPAT_MODE
+    #define INSTANCE_AMOUNT 1
+    #define INSTANCE 0 // one draw per instance
+#else
+    #define INSTANCE_AMOUNT 16
+    #define INSTANCE gl_InstanceID
+#endif
 
 #ifdef VERTEX
 in vec4 vx_position;
 in vec2 vx_uv;
 in vec4 vx_color;
+in vec4 vx_bone;
+in vec4 vx_weight;
 
 uniform mat4 projection;
+uniform mat4 model_view[INSTANCE_AMOUNT]; // identity for already transformed vertices
+uniform vec4 tint[INSTANCE_AMOUNT];
+uniform vec4 uv_rect; // xy: scale, zw: offset
+uniform vec4 unpack[2]; // position offset and scale, for 16 bit positions
+
+#ifndef COMPAT_MODE
+// gles2 doesn't have the room for these, the cpu does the skinning there
+uniform mat4 bones[BONE_AMOUNT];
+uniform int skinned; // = 0;
+#endif
+
 uniform vec2 resolution;
 uniform vec3 target;
 uniform float far; // = 15.0;
@@ -25,11 +48,27 @@ out vec3 lighting;
 out float fog;
 
 void main() {
-    position = vx_position.xyz;
-    color = vx_color / 255.0;
-    uv = vx_uv;
+    vec4 local_position = vec4(unpack[0].xyz + vx_position.xyz * unpack[1].xyz, 1.0);
+
+#ifndef COMPAT_MODE
+    if (skinned != 0) {
+        mat4 skin =
+            bones[int(vx_bone.x)] * vx_weight.x +
+            bones[int(vx_bone.y)] * vx_weight.y +
+            bones[int(vx_bone.z)] * vx_weight.z +
+            bones[int(vx_bone.w)] * vx_weight.w;
+
+        local_position = skin * local_position;
+    }
+#endif
+
+    vec4 view_position = model_view[INSTANCE] * local_position;
+
+    position = view_position.xyz;
+    color = (vx_color / 255.0) * tint[INSTANCE];
+    uv = vx_uv * uv_rect.xy + uv_rect.zw;
 
-    gl_Position = projection * vx_position;
+    gl_Position = projection * view_position;
     gl_Position.xyz /= max(gl_Position.w, 0.0001);
     gl_Position.w = 1.0;
 
@@ -42,7 +81,7 @@ void main() {
 
     lighting = ambient;
     for (int i = 0; i < light_amount; i++) {
-        float dist = distance(light_positions[i], vx_position.xyz);
+        float dist = distance(light_positions[i], position);
         float inv_sqr_law = 1.0 / max(0.8, dist * dist);
 
         lighting += light_colors[i] * inv_sqr_law;